@@ -137,6 +137,61 @@ size_t xPortGetMinimumEverFreeHeapSize( void ) PRIVILEGED_FUNCTION;
 uint32_t vPortMemoryScan(void);
 void vPortCheckIntegrity(void);
 
+/*
+ * Free block size histogram. Bucket 0 counts the blocks smaller than 32 bytes,
+ * bucket n the blocks from 16 << n up to 32 << n bytes and the last bucket
+ * every larger block. Sizes include the block header.
+ */
+#define portHEAP_HISTOGRAM_BUCKETS		12
+
+typedef struct xHEAP_FRAGMENTATION_STATS
+{
+	size_t xFreeBytes;
+	size_t xFreeBlocks;
+	size_t xLargestFreeBlock;		/* Largest allocation that can succeed, plus its header. */
+	size_t xSmallestFreeBlock;
+	size_t xHistogram[ portHEAP_HISTOGRAM_BUCKETS ];
+	uint32_t ulAllocations;			/* Successful pvPortMalloc() calls since boot. */
+	uint32_t ulFrees;
+	uint32_t ulFailedAllocations;
+} HeapFragmentationStats_t;
+
+void vPortGetHeapFragmentationStats( HeapFragmentationStats_t *pxStats ) PRIVILEGED_FUNCTION;
+
+#if( configUSE_MALLOC_DEBUG == 1 )
+/*
+ * Progress and findings of the incremental heap scanner, see
+ * xPortMemoryScanStep().
+ */
+typedef struct xHEAP_SCAN_STATUS
+{
+	uint32_t ulPasses;				/* Complete passes since boot. */
+	uint32_t ulBlocksAllocated;		/* Blocks currently allocated. */
+	uint32_t ulBlocksScanned;		/* Blocks done in the current pass. */
+	uint32_t ulOverflows;			/* Corrupted canaries in the last complete pass. */
+	uint32_t ulOrphans;				/* Unreferenced blocks in the last complete pass. */
+	uint32_t ulLastFinding;			/* Address of the last buffer found corrupted or orphaned. */
+	uint32_t ulLastFindingSize;
+	char pcLastFindingOwner[ configMAX_TASK_NAME_LEN ];
+} HeapScanStatus_t;
+
+BaseType_t xPortMemoryScanStep( size_t xMaxWords );
+void vPortGetMemoryScanStatus( HeapScanStatus_t *pxStatus );
+
+/*
+ * Heap usage of a task. Blocks allocated before the scheduler started have a
+ * NULL owner.
+ */
+typedef struct xHEAP_OWNER_STATS
+{
+	void *pvOwner;					/* TaskHandle_t of the task that allocated the blocks. */
+	size_t xBytes;					/* Including the block headers. */
+	size_t xBlocks;
+} HeapOwnerStats_t;
+
+UBaseType_t uxPortGetHeapOwnerStats( HeapOwnerStats_t *pxStats, UBaseType_t uxMaxOwners );
+#endif
+
 /*
  * Setup the hardware ready for the scheduler to take control.  This generally
  * sets up a tick interrupt and sets timers for the correct tick frequency.
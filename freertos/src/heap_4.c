@@ -34,6 +34,7 @@
  * memory management pages of http://www.FreeRTOS.org for more information.
  */
 #include <stdlib.h>
+#include <string.h>
 
 /* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
 all the API functions to use the MPU wrappers.  That should only be done when
@@ -77,6 +78,8 @@ typedef struct A_BLOCK_LINK
 	size_t xBlockSize;						/*<< The size of the free block. */
 #if( configUSE_MALLOC_DEBUG == 1 )
     TaskHandle_t *xOwner;                   /*<< Buffer owner, TODO: Remove */
+    struct A_BLOCK_LINK *pxPrevAlloc;       /*<< Allocated blocks list, NULL while free */
+    struct A_BLOCK_LINK *pxNextAlloc;
 #endif
 } BlockLink_t;
 
@@ -110,6 +113,11 @@ fragmentation. */
 static size_t xFreeBytesRemaining = 0U;
 static size_t xMinimumEverFreeBytesRemaining = 0U;
 
+/* Counters reported by vPortGetHeapFragmentationStats(). */
+static uint32_t ulAllocations = 0U;
+static uint32_t ulFrees = 0U;
+static uint32_t ulFailedAllocations = 0U;
+
 /* Gets set to the top bit of an size_t type.  When this bit in the xBlockSize
 member of an BlockLink_t structure is set then the block belongs to the
 application.  When the bit is free the block is still part of the free heap
@@ -123,9 +131,37 @@ static size_t xBlockAllocatedBit = 0;
 
 void vPortAddToList(uint32_t pointer);
 uint8_t vPortRmFromList(uint32_t pointer);
-#endif
 
-BlockLink_t *allocList[256] = {0};
+/* Allocated blocks, most recent first, linked through their headers */
+static BlockLink_t *pxAllocList = NULL;
+
+/* State of the incremental scanner, see xPortMemoryScanStep() */
+typedef enum
+{
+    eScanIdle,          /* Between passes */
+    eScanFree,          /* Check the head canary of pxFree and walk the free list */
+    eScanBlockStart,    /* Check the canaries of pxBlock and find its owner */
+    eScanWords,         /* Look for pxBlock's buffer address in pulWord..pulEnd */
+} ScanState_t;
+
+static struct
+{
+    ScanState_t eState;
+    BlockLink_t *pxFree;        /* Next free block to check, NULL at the end */
+    BlockLink_t *pxBlock;       /* Block being scanned */
+    uint32_t ulAddress;         /* Buffer address of pxBlock */
+    UBaseType_t uxRange;        /* 0: owner stack, then ram_regions[uxRange - 1] */
+    uint32_t *pulWord;
+    uint32_t *pulEnd;
+    uint32_t ulOverflows;       /* Findings of the pass in progress */
+    uint32_t ulOrphans;
+} xScan = { eScanIdle, NULL, NULL, 0, 0, NULL, NULL, 0, 0 };
+
+static HeapScanStatus_t xScanStatus;
+
+static void prvScanNextBlock(void);
+static void prvScanFreeListChanged(void);
+#endif
 
 
 /*************************
@@ -139,7 +175,20 @@ BlockLink_t *allocList[256] = {0};
 #define HEAD_CANARY(x) (x->head_canary)
 #define TAIL_CANARY(x) *(uint32_t*)((uint32_t)x + (x->xBlockSize & ~xBlockAllocatedBit) - 4)
 
+static void prvReportOverflow(BlockLink_t *pxBlock) {
+    printf("Detected buffer overflow\n");
+    if (pxBlock->xOwner) {
+        TaskStatus_t status;
+        vTaskGetInfo(pxBlock->xOwner, &status, 0, 0);
+        uint32_t buffer_address = (uint32_t)pxBlock + xHeapStructSize;
+        uint32_t buffer_size = (uint32_t)pxBlock->xBlockSize & ~xBlockAllocatedBit;
+        printf("Task owner %s buffer address %lx size %lu\n", status.pcTaskName, buffer_address, buffer_size);
+    }
+}
+
 void OPTIMIZE_FAST vPortCheckIntegrity(void) {
+    vTaskSuspendAll();
+
     //Scan free list
     BlockLink_t *start = &xStart;
     do {
@@ -148,73 +197,63 @@ void OPTIMIZE_FAST vPortCheckIntegrity(void) {
     } while (start->pxNextFreeBlock != NULL);
 
     //Scan allocated list
-    uint16_t pos = 0;
-    do {
-        if (HEAD_CANARY(allocList[pos]) != HEAD_CANARY_PATTERN) {
-            printf("Detected buffer overflow\n");
-            if (allocList[pos]->xOwner) {
-                TaskStatus_t status;
-                vTaskGetInfo(allocList[pos]->xOwner, &status, 0, 0);
-                uint32_t buffer_address = (uint32_t)allocList[pos] + xHeapStructSize;
-                uint32_t buffer_size = (uint32_t)allocList[pos]->xBlockSize & ~xBlockAllocatedBit;
-                printf("Task owner %s buffer address %lx size %lu\n", status.pcTaskName, buffer_address, buffer_size);
-            }
+    for (BlockLink_t *pxBlock = pxAllocList; pxBlock != NULL; pxBlock = pxBlock->pxNextAlloc) {
+        if (HEAD_CANARY(pxBlock) != HEAD_CANARY_PATTERN) {
+            prvReportOverflow(pxBlock);
         }
-        configASSERT(HEAD_CANARY(allocList[pos]) == HEAD_CANARY_PATTERN);
-        if (TAIL_CANARY(allocList[pos]) != TAIL_CANARY_PATTERN) {
-            printf("Detected buffer overflow\n");
-            if (allocList[pos]->xOwner) {
-                TaskStatus_t status;
-                vTaskGetInfo(allocList[pos]->xOwner, &status, 0, 0);
-                uint32_t buffer_address = (uint32_t)allocList[pos] + xHeapStructSize;
-                uint32_t buffer_size = (uint32_t)allocList[pos]->xBlockSize & ~xBlockAllocatedBit;
-                printf("Task owner %s buffer address %lx size %lu\n", status.pcTaskName, buffer_address, buffer_size);
-            }
-        }
-        configASSERT(TAIL_CANARY(allocList[pos]) == TAIL_CANARY_PATTERN);
-        pos++;
-        if (allocList[pos] == NULL) {
-            break;
+        configASSERT(HEAD_CANARY(pxBlock) == HEAD_CANARY_PATTERN);
+        if (TAIL_CANARY(pxBlock) != TAIL_CANARY_PATTERN) {
+            prvReportOverflow(pxBlock);
         }
-    } while (pos < (sizeof(allocList) / sizeof(BlockLink_t*)));
-}
+        configASSERT(TAIL_CANARY(pxBlock) == TAIL_CANARY_PATTERN);
+    }
 
-void OPTIMIZE_FAST vPortUpdateFreeBlockList(void) {
-    BlockLink_t *start = &xStart;
-    do {
-        HEAD_CANARY(start) = HEAD_CANARY_PATTERN;
-        start = start->pxNextFreeBlock;
-    } while(start->pxNextFreeBlock != NULL);
+    ( void ) xTaskResumeAll();
 }
 
+/* Must be called with the scheduler suspended */
 void OPTIMIZE_FAST vPortAddToList(uint32_t pointer) {
-    uint16_t pos = 0;
     BlockLink_t *temp = (BlockLink_t*)pointer;
     HEAD_CANARY(temp) = HEAD_CANARY_PATTERN;
     TAIL_CANARY(temp) = TAIL_CANARY_PATTERN;
-    do {
-        if (allocList[pos] == NULL) {
-            allocList[pos] = (BlockLink_t*)pointer;
-            break;
-        }
-    } while (allocList[pos++] != NULL && pos < (sizeof(allocList) / sizeof(uint32_t)));
-    vPortUpdateFreeBlockList();
+
+    temp->pxPrevAlloc = NULL;
+    temp->pxNextAlloc = pxAllocList;
+    if (pxAllocList != NULL) {
+        pxAllocList->pxPrevAlloc = temp;
+    }
+    pxAllocList = temp;
+    xScanStatus.ulBlocksAllocated++;
 }
 
+/* Must be called with the scheduler suspended */
 uint8_t OPTIMIZE_FAST vPortRmFromList(uint32_t pointer) {
-    uint16_t pos;
-    for (pos = 0; pos < (sizeof(allocList) / sizeof(uint32_t)); pos++) {
-        if (allocList[pos] == (BlockLink_t*)pointer) {
-            allocList[pos] = NULL;
-            break;
-        }
+    BlockLink_t *temp = (BlockLink_t*)pointer;
+
+    /* Check the neighbours point back to this block before unlinking it */
+    if ((temp->pxPrevAlloc ? temp->pxPrevAlloc->pxNextAlloc : pxAllocList) != temp) {
+        return 0xFF;
     }
-    if (pos == (sizeof(allocList) / sizeof(uint32_t))) {
+    if (temp->pxNextAlloc && (temp->pxNextAlloc->pxPrevAlloc != temp)) {
         return 0xFF;
     }
-    for (; pos < (sizeof(allocList) / sizeof(uint32_t) - 1); pos++) {
-        allocList[pos] = allocList[pos + 1];
+
+    /* Don't leave the incremental scanner pointing to a free block */
+    if (temp == xScan.pxBlock) {
+        prvScanNextBlock();
+    }
+
+    if (temp->pxPrevAlloc != NULL) {
+        temp->pxPrevAlloc->pxNextAlloc = temp->pxNextAlloc;
+    } else {
+        pxAllocList = temp->pxNextAlloc;
+    }
+    if (temp->pxNextAlloc != NULL) {
+        temp->pxNextAlloc->pxPrevAlloc = temp->pxPrevAlloc;
     }
+    temp->pxPrevAlloc = NULL;
+    temp->pxNextAlloc = NULL;
+    xScanStatus.ulBlocksAllocated--;
     return 0;
 }
 
@@ -247,14 +286,15 @@ static inline uint8_t isCurrentStackAddress(TaskHandle_t task, uint32_t *x) {
 }
 
 uint32_t OPTIMIZE_FAST vPortMemoryScan(void) {
-    uint16_t pos = 0;
     uint32_t orphaned_buffers = 0;
-    // Cycle through pointer array until null pointer is found
-    while (allocList[pos] != NULL) {
+    // Blocks can't be freed while walking the list
+    vTaskSuspendAll();
+    // Cycle through the allocated blocks list
+    for (BlockLink_t *pxBlock = pxAllocList; pxBlock != NULL; pxBlock = pxBlock->pxNextAlloc) {
         // Get address of allocated buffer that will be referenced in the memory
-        uint32_t allocatedAddress = xHeapStructSize + (uint32_t)allocList[pos];
+        uint32_t allocatedAddress = xHeapStructSize + (uint32_t)pxBlock;
         // Get buffer owner
-        TaskHandle_t xTask = (TaskHandle_t)allocList[pos]->xOwner;
+        TaskHandle_t xTask = (TaskHandle_t)pxBlock->xOwner;
         uint8_t found = 0;
         // Only check if there is buffer owner
         if (xTask != NULL) {
@@ -299,14 +339,217 @@ uint32_t OPTIMIZE_FAST vPortMemoryScan(void) {
                     // Didn't found any references to a pointer
                     orphaned_buffers++;
                     printf("Didn't find reference to buffer %lx (size %d) in task %s\n",
-                            allocatedAddress, allocList[pos]->xBlockSize - xBlockAllocatedBit, status.pcTaskName);
+                            allocatedAddress, pxBlock->xBlockSize - xBlockAllocatedBit, status.pcTaskName);
                 }
             }
         }
-        pos++;
     }
+    ( void ) xTaskResumeAll();
     return orphaned_buffers;
 }
+
+/* Must be called with the scheduler suspended. The free block the scanner
+ * resumes from may have been allocated or merged, the rest of the free list
+ * is left for the next pass */
+static void prvScanFreeListChanged(void) {
+    if (xScan.eState == eScanFree) {
+        xScan.pxFree = NULL;
+    }
+}
+
+/* Must be called with the scheduler suspended */
+static void prvScanNextBlock(void) {
+    xScan.pxBlock = xScan.pxBlock->pxNextAlloc;
+    xScan.eState = eScanBlockStart;
+    xScanStatus.ulBlocksScanned++;
+}
+
+static void prvScanFinding(BlockLink_t *pxBlock, uint32_t *pulCounter, const char *pcWhat) {
+    TaskStatus_t status;
+
+    (*pulCounter)++;
+    xScanStatus.ulLastFinding = (uint32_t)pxBlock + xHeapStructSize;
+    xScanStatus.ulLastFindingSize = pxBlock->xBlockSize & ~xBlockAllocatedBit;
+    xScanStatus.pcLastFindingOwner[0] = '\0';
+    if (pxBlock->xOwner) {
+        vTaskGetInfo(pxBlock->xOwner, &status, 0, 0);
+        strncpy(xScanStatus.pcLastFindingOwner, status.pcTaskName, configMAX_TASK_NAME_LEN - 1);
+        xScanStatus.pcLastFindingOwner[configMAX_TASK_NAME_LEN - 1] = '\0';
+    }
+    printf("%s buffer %lx (size %lu) in task %s\n", pcWhat, xScanStatus.ulLastFinding,
+            xScanStatus.ulLastFindingSize, xScanStatus.pcLastFindingOwner);
+}
+
+/* Sets pulWord..pulEnd to the next range where references to the current block
+   are looked for. Returns pdFALSE when there are no more ranges. */
+static BaseType_t prvScanSetRange(void) {
+    for (;;) {
+        if (xScan.uxRange == 0) {
+            TaskStatus_t status;
+            vTaskGetInfo((TaskHandle_t)xScan.pxBlock->xOwner, &status, 0, 0);
+            xScan.pulWord = status.pxStackBase;
+            xScan.pulEnd = (uint32_t*)((uint32_t)xScan.pxBlock->xOwner - xHeapStructSize);
+        } else if (xScan.uxRange <= (sizeof ram_regions / sizeof ram_regions[0])) {
+            xScan.pulWord = ram_regions[xScan.uxRange - 1].startAddress;
+            xScan.pulEnd = ram_regions[xScan.uxRange - 1].endAddress;
+        } else {
+            return pdFALSE;
+        }
+        if (xScan.pulWord < xScan.pulEnd) {
+            return pdTRUE;
+        }
+        xScan.uxRange++;
+    }
+}
+
+/*
+ * Runs a slice of the incremental leak and overflow scanner: checks the
+ * canaries of the allocated blocks and looks for references to them in their
+ * owner's stack and in ram_regions, like vPortCheckIntegrity() and
+ * vPortMemoryScan() do, but reading at most xMaxWords words per call and
+ * resuming where the previous call left off. Blocks freed in between are
+ * skipped, blocks allocated in between are left for the next pass.
+ * Returns pdTRUE when the call completed a pass.
+ */
+BaseType_t OPTIMIZE_FAST xPortMemoryScanStep( size_t xMaxWords ) {
+    BaseType_t xPassDone = pdFALSE;
+    TaskStatus_t status;
+
+    vTaskSuspendAll();
+
+    // The scanner's own stack may hold the addresses being looked for
+    vTaskGetInfo(xTaskGetCurrentTaskHandle(), &status, 0, 0);
+    uint32_t *pulOwnStack = status.pxStackBase;
+    uint32_t *pulOwnStackEnd = (uint32_t*)xTaskGetCurrentTaskHandle();
+
+    while ((xMaxWords > 0) && !xPassDone) {
+        switch (xScan.eState) {
+        case eScanIdle:
+            xScan.pxFree = xStart.pxNextFreeBlock;
+            xScan.eState = eScanFree;
+            break;
+
+        case eScanFree:
+            // Free blocks only have a head canary. The walk is resumed from
+            // pxFree, which prvScanFreeListChanged() clears if it goes stale
+            while ((xMaxWords > 0) && (xScan.pxFree != NULL)) {
+                if (HEAD_CANARY(xScan.pxFree) != HEAD_CANARY_PATTERN) {
+                    xScan.ulOverflows++;
+                }
+                xScan.pxFree = xScan.pxFree->pxNextFreeBlock;
+                xMaxWords--;
+            }
+            if (xScan.pxFree != NULL) {
+                // Out of budget, resume from here on the next call
+                break;
+            }
+            xScan.pxBlock = pxAllocList;
+            xScan.eState = eScanBlockStart;
+            xScanStatus.ulBlocksScanned = 0;
+            break;
+
+        case eScanBlockStart:
+            if (xScan.pxBlock == NULL) {
+                xScanStatus.ulOverflows = xScan.ulOverflows;
+                xScanStatus.ulOrphans = xScan.ulOrphans;
+                xScanStatus.ulPasses++;
+                xScan.ulOverflows = 0;
+                xScan.ulOrphans = 0;
+                xScan.eState = eScanIdle;
+                xPassDone = pdTRUE;
+                break;
+            }
+            xMaxWords--;
+            if ((HEAD_CANARY(xScan.pxBlock) != HEAD_CANARY_PATTERN) ||
+                    (TAIL_CANARY(xScan.pxBlock) != TAIL_CANARY_PATTERN)) {
+                prvScanFinding(xScan.pxBlock, &xScan.ulOverflows, "Detected overflow in");
+            }
+            // Only check if there is buffer owner
+            if (xScan.pxBlock->xOwner == NULL) {
+                prvScanNextBlock();
+                break;
+            }
+            xScan.ulAddress = (uint32_t)xScan.pxBlock + xHeapStructSize;
+            xScan.uxRange = 0;
+            if (prvScanSetRange()) {
+                xScan.eState = eScanWords;
+            } else {
+                prvScanNextBlock();
+            }
+            break;
+
+        case eScanWords: {
+            uint8_t found = 0;
+            while ((xMaxWords > 0) && (xScan.pulWord < xScan.pulEnd)) {
+                xMaxWords--;
+                if ((*xScan.pulWord == xScan.ulAddress) &&
+                        ((xScan.pulWord < pulOwnStack) || (xScan.pulWord >= pulOwnStackEnd))) {
+                    found = 1;
+                    break;
+                }
+                xScan.pulWord++;
+            }
+            if (found) {
+                prvScanNextBlock();
+                break;
+            }
+            if (xScan.pulWord < xScan.pulEnd) {
+                // Out of budget, resume from here on the next call
+                break;
+            }
+            xScan.uxRange++;
+            if (!prvScanSetRange()) {
+                // Didn't find any references to the buffer
+                prvScanFinding(xScan.pxBlock, &xScan.ulOrphans, "Didn't find reference to");
+                prvScanNextBlock();
+            }
+            break;
+        }
+        }
+    }
+
+    ( void ) xTaskResumeAll();
+    return xPassDone;
+}
+
+void vPortGetMemoryScanStatus( HeapScanStatus_t *pxStatus ) {
+    vTaskSuspendAll();
+    *pxStatus = xScanStatus;
+    ( void ) xTaskResumeAll();
+}
+
+/*
+ * Fills pxStats with the bytes and blocks allocated by each task, in order of
+ * first appearance in the allocated list. Returns the number of entries
+ * filled, or uxMaxOwners + 1 if there were more owners than entries.
+ */
+UBaseType_t uxPortGetHeapOwnerStats( HeapOwnerStats_t *pxStats, UBaseType_t uxMaxOwners ) {
+    UBaseType_t uxOwners = 0;
+
+    vTaskSuspendAll();
+    for (BlockLink_t *pxBlock = pxAllocList; pxBlock != NULL; pxBlock = pxBlock->pxNextAlloc) {
+        UBaseType_t i;
+        for (i = 0; (i < uxOwners) && (i < uxMaxOwners); i++) {
+            if (pxStats[i].pvOwner == (void *)pxBlock->xOwner) {
+                break;
+            }
+        }
+        if (i == uxOwners) {
+            uxOwners++;
+            if (i < uxMaxOwners) {
+                pxStats[i].pvOwner = (void *)pxBlock->xOwner;
+                pxStats[i].xBytes = 0;
+                pxStats[i].xBlocks = 0;
+            }
+        }
+        if (i < uxMaxOwners) {
+            pxStats[i].xBytes += pxBlock->xBlockSize & ~xBlockAllocatedBit;
+            pxStats[i].xBlocks++;
+        }
+    }
+    ( void ) xTaskResumeAll();
+    return uxOwners;
+}
 #endif
 
 /*************************
@@ -397,6 +640,9 @@ void *pvReturn = NULL;
 					/* This block is being returned for use so must be taken out
 					of the list of free blocks. */
 					pxPreviousBlock->pxNextFreeBlock = pxBlock->pxNextFreeBlock;
+#if( configUSE_MALLOC_DEBUG == 1 )
+					prvScanFreeListChanged();
+#endif
 
 					/* If the block is larger than required it can be split into
 					two. */
@@ -408,6 +654,9 @@ void *pvReturn = NULL;
 						compiler. */
 						pxNewBlockLink = ( void * ) ( ( ( uint8_t * ) pxBlock ) + xWantedSize );
 						configASSERT( ( ( ( size_t ) pxNewBlockLink ) & portBYTE_ALIGNMENT_MASK ) == 0 );
+#if( configUSE_MALLOC_DEBUG == 1 )
+						HEAD_CANARY(pxNewBlockLink) = HEAD_CANARY_PATTERN;
+#endif
 
 						/* Calculate the sizes of two blocks split from the
 						single block. */
@@ -454,6 +703,15 @@ void *pvReturn = NULL;
 		}
 
 		traceMALLOC( pvReturn, xWantedSize );
+
+		if( pvReturn != NULL )
+		{
+			ulAllocations++;
+		}
+		else
+		{
+			ulFailedAllocations++;
+		}
 	}
 #if( configUSE_MALLOC_DEBUG == 1 )
     if (pvReturn != NULL) {
@@ -512,6 +770,7 @@ BlockLink_t *pxLink;
 				{
 					/* Add this block to the list of free blocks. */
 					xFreeBytesRemaining += pxLink->xBlockSize;
+					ulFrees++;
 					traceFREE( pv, pxLink->xBlockSize );
 #if( configUSE_MALLOC_DEBUG == 1 )
                     pxLink->xOwner = NULL;
@@ -519,9 +778,6 @@ BlockLink_t *pxLink;
 #endif
 					prvInsertBlockIntoFreeList( ( ( BlockLink_t * ) pxLink ) );
 				}
-#if( configUSE_MALLOC_DEBUG == 1 )
-                vPortUpdateFreeBlockList();
-#endif
 				( void ) xTaskResumeAll();
 			}
 			else
@@ -549,6 +805,47 @@ size_t xPortGetMinimumEverFreeHeapSize( void )
 }
 /*-----------------------------------------------------------*/
 
+void vPortGetHeapFragmentationStats( HeapFragmentationStats_t *pxStats )
+{
+BlockLink_t *pxBlock;
+size_t xSize;
+UBaseType_t uxBucket;
+
+	memset( pxStats, 0, sizeof( *pxStats ) );
+
+	/* Only the free list is walked, so the cost depends on the fragmentation
+	and not on the number of allocated blocks. */
+	vTaskSuspendAll();
+	{
+		for( pxBlock = xStart.pxNextFreeBlock; ( pxBlock != NULL ) && ( pxBlock != pxEnd ); pxBlock = pxBlock->pxNextFreeBlock )
+		{
+			xSize = pxBlock->xBlockSize;
+
+			pxStats->xFreeBlocks++;
+			if( xSize > pxStats->xLargestFreeBlock )
+			{
+				pxStats->xLargestFreeBlock = xSize;
+			}
+			if( ( pxStats->xSmallestFreeBlock == 0 ) || ( xSize < pxStats->xSmallestFreeBlock ) )
+			{
+				pxStats->xSmallestFreeBlock = xSize;
+			}
+
+			for( uxBucket = 0; ( uxBucket < ( portHEAP_HISTOGRAM_BUCKETS - 1 ) ) && ( xSize >= ( ( size_t ) 32 << uxBucket ) ); uxBucket++ )
+			{
+			}
+			pxStats->xHistogram[ uxBucket ]++;
+		}
+
+		pxStats->xFreeBytes = xFreeBytesRemaining;
+		pxStats->ulAllocations = ulAllocations;
+		pxStats->ulFrees = ulFrees;
+		pxStats->ulFailedAllocations = ulFailedAllocations;
+	}
+	( void ) xTaskResumeAll();
+}
+/*-----------------------------------------------------------*/
+
 void vPortInitialiseBlocks( void )
 {
 	/* This just exists to keep the linker quiet. */
@@ -594,6 +891,14 @@ size_t xTotalHeapSize = configTOTAL_HEAP_SIZE;
 	pxFirstFreeBlock->xBlockSize = uxAddress - ( size_t ) pxFirstFreeBlock;
 	pxFirstFreeBlock->pxNextFreeBlock = pxEnd;
 
+#if( configUSE_MALLOC_DEBUG == 1 )
+	/* Free blocks get their canary when they are created, merged blocks keep
+	the canary of the lower one */
+	xStart.head_canary = HEAD_CANARY_PATTERN;
+	HEAD_CANARY(pxEnd) = HEAD_CANARY_PATTERN;
+	HEAD_CANARY(pxFirstFreeBlock) = HEAD_CANARY_PATTERN;
+#endif
+
 	/* Only one block exists - and it covers the entire usable heap space. */
 	xMinimumEverFreeBytesRemaining = pxFirstFreeBlock->xBlockSize;
 	xFreeBytesRemaining = pxFirstFreeBlock->xBlockSize;
@@ -608,6 +913,10 @@ static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert )
 BlockLink_t *pxIterator;
 uint8_t *puc;
 
+#if( configUSE_MALLOC_DEBUG == 1 )
+	prvScanFreeListChanged();
+#endif
+
 	/* Iterate through the list until a block is found that has a higher address
 	than the block being inserted. */
 	for( pxIterator = &xStart; pxIterator->pxNextFreeBlock < pxBlockToInsert; pxIterator = pxIterator->pxNextFreeBlock )
@@ -90,8 +90,21 @@ typedef uintptr_t          mem_ptr_t;
 //	#define ALIGNED(n)  __align(n)
 #endif 
 
+/**
+ * @brief	Internet checksum tuned for the Cortex-M4, replaces the lwIP
+ * reference routines
+ * @param	dataptr	: data to sum, at any alignment
+ * @param	len		: number of bytes
+ * @return	Non inverted sum, in the byte order lwIP expects
+ */
+u16_t lpc_chksum(const void *dataptr, int len);
+
+#if LPC_CHKSUM
+#define LWIP_CHKSUM lpc_chksum
+#else
 /* Used with IP headers only */
 #define LWIP_CHKSUM_ALGORITHM 1
+#endif
 
 #ifdef LWIP_DEBUG
 /**
@@ -67,6 +67,45 @@ void lpc_enetif_input(struct netif *netif);
  */
 s32_t lpc_rx_queue(struct netif *netif);
 
+/**
+ * @brief	Receive counters of the zero-copy RX buffer ring
+ */
+struct lpc_rx_stats {
+	u32_t frames;			/**< Frames passed up to lwIP */
+	u32_t bytes;			/**< Bytes passed up to lwIP */
+	u32_t pool_size;		/**< Buffers in the ring */
+	u32_t pool_free;		/**< Buffers neither queued nor held by lwIP */
+	u32_t pool_free_min;	/**< Lowest pool_free seen */
+	u32_t starved;			/**< Refills that found no free buffer */
+	u32_t csum_sw;			/**< Frames the MAC couldn't checksum, checked in software */
+	u32_t wakeups;			/**< Receive task wakeups that found frames */
+	u32_t batch_max;		/**< Most frames drained in one wakeup */
+};
+
+/**
+ * @brief	Returns the receive counters
+ * @param	stats	: structure to fill
+ * @return	Nothing
+ */
+void lpc_rx_get_stats(struct lpc_rx_stats *stats);
+
+/**
+ * @brief	Transmit descriptor backpressure counters
+ */
+struct lpc_tx_stats {
+	u32_t stalls;			/**< Frames that had to wait for free descriptors */
+	u32_t timeouts;			/**< Frames dropped after waiting LPC_TX_WAIT_MS */
+	u32_t wait_us;			/**< Total time spent waiting */
+	u32_t wait_max_us;		/**< Longest single wait */
+};
+
+/**
+ * @brief	Returns the transmit backpressure counters
+ * @param	stats	: structure to fill
+ * @return	Nothing
+ */
+void lpc_tx_get_stats(struct lpc_tx_stats *stats);
+
 /**
  * @brief	Polls if an available TX descriptor is ready
  * @param	netif	: lwip network interface structure pointer
@@ -41,10 +41,25 @@
 #include "semphr.h"
 
 #define SYS_MBOX_NULL					( ( QueueHandle_t ) NULL )
-#define SYS_SEM_NULL					( ( SemaphoreHandle_t ) NULL )
 #define SYS_DEFAULT_THREAD_STACK_DEPTH	configMINIMAL_STACK_SIZE
 
+#if SYS_ARCH_SEM_NOTIFY
+/* Binary semaphore waking its waiter with this notification bit. Every
+   lwIP semaphore has at most one waiting task at a time */
+#define SYS_SEM_NOTIFY_BIT				( 1UL << 31 )
+
+struct sys_sem {
+	TaskHandle_t xWaiter;		/* Task blocked in sys_arch_sem_wait(), or NULL */
+	u8_t ucCount;				/* 0 or 1 */
+};
+
+typedef struct sys_sem *sys_sem_t;
+#define SYS_SEM_NULL					( ( sys_sem_t ) NULL )
+#else
 typedef SemaphoreHandle_t sys_sem_t;
+#define SYS_SEM_NULL					( ( SemaphoreHandle_t ) NULL )
+#endif
+
 typedef SemaphoreHandle_t sys_mutex_t;
 typedef QueueHandle_t sys_mbox_t;
 typedef TaskHandle_t sys_thread_t;
@@ -54,6 +69,9 @@ typedef int sys_prot_t;
 #define sys_mbox_set_invalid( x ) ( ( *x ) = NULL )
 #define sys_sem_valid( x ) ( ( ( *x ) == NULL) ? pdFALSE : pdTRUE )
 #define sys_sem_set_invalid( x ) ( ( *x ) = NULL )
+
+/* Signals a semaphore from an interrupt handler */
+void sys_sem_signal_from_isr( sys_sem_t *pxSemaphore, BaseType_t *pxHigherPriorityTaskWoken );
 #endif
 
 #endif /* __ARCH_SYS_ARCH_H__ */
@@ -36,12 +36,18 @@
 #include "lwip/pbuf.h"
 #include "lwip/stats.h"
 #include "lwip/snmp.h"
+#include "lwip/ip.h"
+#include "lwip/udp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/tcpip.h"
 #include "netif/etharp.h"
 #include "netif/ppp_oe.h"
 
 #include "arch/lpc18xx_43xx_emac.h"
 #include "arch/lpc_arch.h"
 #include "arch/sys_arch.h"
+#include "rtos_static.h"
+#include "mem_sections.h"
 
 #include "chip.h"
 #include "board.h"
@@ -60,6 +66,18 @@ extern void msDelay(uint32_t ms);
 #error LPC_NUM_BUFF_RXDESCS must be at least 3
 #endif
 
+#if LPC_RX_BUDGET < 1
+#error LPC_RX_BUDGET must be at least 1
+#endif
+
+#if LPC_NUM_RX_PBUFS < LPC_NUM_BUFF_RXDESCS
+#error LPC_NUM_RX_PBUFS must be at least LPC_NUM_BUFF_RXDESCS
+#endif
+
+#ifndef LPC_CHECKSUM_OFFLOAD
+#define LPC_CHECKSUM_OFFLOAD 0
+#endif
+
 #ifndef LPC_CHECK_SLOWMEM
 #error LPC_CHECK_SLOWMEM must be 0 or 1
 #endif
@@ -92,6 +110,26 @@ extern void msDelay(uint32_t ms);
  * so use it only for debug. */
 // #define LOCK_RX_THREAD
 
+#if LPC_CHECKSUM_OFFLOAD
+/* RX checksum offload status. RDES0 ESA flags a valid RDES4, which holds
+   the result of the IP header and payload checks */
+#define LPC_RDES_ESA		(1 << 0)	/**< Extended status available */
+#define LPC_RDES4_IPPT		(7 << 0)	/**< Payload type, 0 if not TCP/UDP/ICMP */
+#define LPC_RDES4_IPHE		(1 << 3)	/**< IP header checksum error */
+#define LPC_RDES4_IPPE		(1 << 4)	/**< TCP/UDP/ICMP checksum error */
+#define LPC_RDES4_IPCB		(1 << 5)	/**< Checksum offload bypassed */
+#define LPC_RDES4_IPV4		(1 << 6)	/**< IPv4 frame */
+#endif
+
+/* Zero-copy RX buffer. The DMA writes the frame straight into data, which
+   is passed up to lwIP as a custom pbuf. Freeing the pbuf puts the buffer
+   back in the ring instead of releasing it to the lwIP heap */
+struct lpc_rx_pbuf {
+	struct pbuf_custom pc;		/**< Must be first, lwIP frees through it */
+	struct lpc_rx_pbuf *next;	/**< Free list link */
+	u8_t data[EMAC_ETH_MAX_FLEN] __attribute__((aligned(4)));	/**< Frame buffer */
+};
+
 /* LPC EMAC driver data structure */
 struct lpc_enetdata {
 	struct netif *netif;		/**< Reference back to LWIP parent netif */
@@ -108,16 +146,33 @@ struct lpc_enetdata {
 	volatile u32_t rx_free_descs;	/**< Number of free RX descriptors */
 	volatile u32_t rx_get_idx;	/**< Index to next RX descriptor that id to be received */
 	u32_t rx_next_idx;	/**< Index to next RX descriptor that needs a pbuf */
+	struct lpc_rx_pbuf *rx_free_pbufs;	/**< Ring buffers not queued nor held by lwIP */
+	struct lpc_rx_stats rx_stats;	/**< Receive counters */
+#if NO_SYS == 0
+	struct pbuf *rx_batch[LPC_NUM_RX_PBUFS + 1];	/**< Frames waiting for the tcpip thread */
+	volatile u32_t rx_batch_head;	/**< Next rx_batch slot to fill, receive task */
+	volatile u32_t rx_batch_tail;	/**< Next rx_batch slot to input, tcpip thread */
+	volatile u32_t rx_batch_posted;	/**< lpc_rx_batch_input() is queued */
+#endif
 #if NO_SYS == 0
 	sys_sem_t RxSem;/**< RX receive thread wakeup semaphore */
 	sys_sem_t TxCleanSem;	/**< TX cleanup thread wakeup semaphore */
 	sys_mutex_t TXLockMutex;/**< TX critical section mutex */
-	SemaphoreHandle_t xTXDCountSem;	/**< TX free buffer counting semaphore */
+	SemaphoreHandle_t xTXDCountSem;	/**< Given for every reclaimed TX descriptor */
 #endif
+	struct lpc_tx_stats tx_stats;	/**< Transmit backpressure counters */
 };
 
-/* LPC EMAC driver work data */
-static struct lpc_enetdata lpc_enetdata;
+/* LPC EMAC driver work data. The descriptors are read and written by the
+   DMA, keep them in AHB SRAM away from the CPU local banks */
+static struct lpc_enetdata BSS_RAMAHB lpc_enetdata;
+
+/* Zero-copy RX buffer ring, also written by the DMA */
+static struct lpc_rx_pbuf BSS_RAMAHB lpc_rx_pbufs[LPC_NUM_RX_PBUFS];
+
+/* lwIP heap, the TX pbufs handed to the DMA come from here. mem.c
+   needs room for two struct mem and the alignment besides MEM_SIZE */
+u8_t BSS_RAMAHB __attribute__((aligned(MEM_ALIGNMENT))) lpc_ram_heap[MEM_SIZE + 32];
 
 static uint32_t intMask;
 
@@ -138,6 +193,62 @@ const static struct lpc_slowmem_array_t slmem[] = LPC_SLOWMEM_ARRAY;
  * Private functions
  ****************************************************************************/
 
+/* Returns a ring buffer released by lwIP to the free list. Runs in the
+   context of whoever frees the pbuf, usually the tcpip thread */
+static void lpc_rx_pbuf_free(struct pbuf *p)
+{
+	struct lpc_rx_pbuf *rxp = (struct lpc_rx_pbuf *) p;
+	struct lpc_enetdata *lpc_netifdata = &lpc_enetdata;
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	rxp->next = lpc_netifdata->rx_free_pbufs;
+	lpc_netifdata->rx_free_pbufs = rxp;
+	lpc_netifdata->rx_stats.pool_free++;
+	SYS_ARCH_UNPROTECT(lev);
+
+#if NO_SYS == 0
+	/* Descriptors left empty are only refilled by the receive thread */
+	if (lpc_netifdata->rx_free_descs > 0) {
+		sys_sem_signal(&lpc_netifdata->RxSem);
+	}
+#endif
+}
+
+/* Takes a buffer from the free list and wraps it in a pbuf covering
+   a maximum size frame */
+static struct pbuf *lpc_rx_pbuf_alloc(struct lpc_enetdata *lpc_netifdata)
+{
+	struct lpc_rx_pbuf *rxp;
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	rxp = lpc_netifdata->rx_free_pbufs;
+	if (rxp != NULL) {
+		lpc_netifdata->rx_free_pbufs = rxp->next;
+		lpc_netifdata->rx_stats.pool_free--;
+		if (lpc_netifdata->rx_stats.pool_free <
+			lpc_netifdata->rx_stats.pool_free_min) {
+			lpc_netifdata->rx_stats.pool_free_min =
+				lpc_netifdata->rx_stats.pool_free;
+		}
+	}
+	else {
+		lpc_netifdata->rx_stats.starved++;
+	}
+	SYS_ARCH_UNPROTECT(lev);
+
+	if (rxp == NULL) {
+		return NULL;
+	}
+
+	/* PBUF_POOL rather than PBUF_REF so lwIP can restore the headers it
+	   strips, as it does before answering with ICMP */
+	rxp->pc.custom_free_function = lpc_rx_pbuf_free;
+	return pbuf_alloced_custom(PBUF_RAW, (u16_t) EMAC_ETH_MAX_FLEN, PBUF_POOL,
+							   &rxp->pc, rxp->data, sizeof(rxp->data));
+}
+
 /* Queues a pbuf into a free RX descriptor */
 static void lpc_rxqueue_pbuf(struct lpc_enetdata *lpc_netifdata,
 							 struct pbuf *p)
@@ -183,6 +294,17 @@ static err_t lpc_rx_setup(struct lpc_enetdata *lpc_netifdata)
 	lpc_netifdata->rx_next_idx = 0;
 	lpc_netifdata->rx_free_descs = LPC_NUM_BUFF_RXDESCS;
 
+	/* All the ring buffers start free */
+	lpc_netifdata->rx_free_pbufs = NULL;
+	for (idx = LPC_NUM_RX_PBUFS - 1; idx >= 0; idx--) {
+		lpc_rx_pbufs[idx].next = lpc_netifdata->rx_free_pbufs;
+		lpc_netifdata->rx_free_pbufs = &lpc_rx_pbufs[idx];
+	}
+	memset(&lpc_netifdata->rx_stats, 0, sizeof(lpc_netifdata->rx_stats));
+	lpc_netifdata->rx_stats.pool_size = LPC_NUM_RX_PBUFS;
+	lpc_netifdata->rx_stats.pool_free = LPC_NUM_RX_PBUFS;
+	lpc_netifdata->rx_stats.pool_free_min = LPC_NUM_RX_PBUFS;
+
 	/* Clear initial RX descriptor list */
 	memset(lpc_netifdata->prdesc, 0, sizeof(lpc_netifdata->prdesc));
 
@@ -203,12 +325,122 @@ static err_t lpc_rx_setup(struct lpc_enetdata *lpc_netifdata)
 	   queued for all descriptors. */
 	if (lpc_rx_queue(lpc_netifdata->netif) != LPC_NUM_BUFF_RXDESCS) {
 		LWIP_DEBUGF(EMAC_DEBUG | LWIP_DBG_TRACE,
-					("lpc_rx_setup: Warning, not enough memory for RX pbufs\n"));
+					("lpc_rx_setup: Warning, not enough RX buffers for all descriptors\n"));
 	}
 
 	return ERR_OK;
 }
 
+#if LPC_CHECKSUM_OFFLOAD
+/* Checks in software the checksums of an IPv4 frame the MAC didn't */
+static int lpc_rx_checksum_sw(u8_t *frame, u16_t len)
+{
+	struct ip_hdr *iphdr = (struct ip_hdr *) (frame + SIZEOF_ETH_HDR);
+	struct pbuf q;
+	ip_addr_t src, dest;
+	u16_t hlen, iplen;
+	u8_t proto;
+
+	/* Malformed frames are left for lwIP to drop */
+	if ((len < SIZEOF_ETH_HDR + IP_HLEN) ||
+		(((struct eth_hdr *) frame)->type != PP_HTONS(ETHTYPE_IP))) {
+		return 1;
+	}
+	hlen = IPH_HL(iphdr) * 4;
+	iplen = ntohs(IPH_LEN(iphdr));
+	if ((hlen < IP_HLEN) || (hlen > iplen) ||
+		(SIZEOF_ETH_HDR + iplen > len)) {
+		return 1;
+	}
+
+	if (inet_chksum(iphdr, hlen) != 0) {
+		return 0;
+	}
+
+	/* The payload checksum of a fragment covers the whole datagram */
+	if (IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) {
+		return 1;
+	}
+
+	proto = IPH_PROTO(iphdr);
+	q.next = NULL;
+	q.payload = (u8_t *) iphdr + hlen;
+	q.len = q.tot_len = iplen - hlen;
+
+	switch (proto) {
+	case IP_PROTO_ICMP:
+		return inet_chksum(q.payload, q.len) == 0;
+
+	case IP_PROTO_UDP:
+		/* A zero UDP checksum means the sender didn't compute one */
+		if ((q.len >= UDP_HLEN) &&
+			(((struct udp_hdr *) q.payload)->chksum == 0)) {
+			return 1;
+		}
+		/* Fall through */
+	case IP_PROTO_TCP:
+		ip_addr_copy(src, iphdr->src);
+		ip_addr_copy(dest, iphdr->dest);
+		return inet_chksum_pseudo(&q, &src, &dest, proto, q.len) == 0;
+
+	default:
+		return 1;
+	}
+}
+
+/* Returns 0 if a received frame has a wrong IP, TCP, UDP or ICMP
+   checksum. The MAC result is used when it has one, frames it skips
+   or gives no extended status for are checked in software */
+static int lpc_rx_checksum_ok(struct lpc_enetdata *lpc_netifdata,
+							  struct pbuf *p, u32_t status, u32_t extstat)
+{
+	/* No extended status, so nothing says the MAC checked an IPv4 frame */
+	if (!(status & LPC_RDES_ESA)) {
+		if (((struct eth_hdr *) p->payload)->type != PP_HTONS(ETHTYPE_IP)) {
+			return 1;
+		}
+		lpc_netifdata->rx_stats.csum_sw++;
+		return lpc_rx_checksum_sw(p->payload, (u16_t) RDES_FLMSK(status));
+	}
+
+	/* Not IPv4, lwIP checks no checksums there */
+	if (!(extstat & LPC_RDES4_IPV4)) {
+		return 1;
+	}
+
+	if (extstat & (LPC_RDES4_IPHE | LPC_RDES4_IPPE)) {
+		return 0;
+	}
+
+	/* Header and payload verified by the MAC */
+	if (!(extstat & LPC_RDES4_IPCB) && (extstat & LPC_RDES4_IPPT)) {
+		return 1;
+	}
+
+	lpc_netifdata->rx_stats.csum_sw++;
+	return lpc_rx_checksum_sw(p->payload, (u16_t) RDES_FLMSK(status));
+}
+#endif
+
+/* Returns if the frame carries a protocol lwIP handles */
+static int lpc_rx_ethertype_ok(struct pbuf *p)
+{
+	struct eth_hdr *ethhdr = p->payload;
+
+	switch (htons(ethhdr->type)) {
+	case ETHTYPE_IP:
+	case ETHTYPE_ARP:
+#if PPPOE_SUPPORT
+	case ETHTYPE_PPPOEDISC:
+	case ETHTYPE_PPPOE:
+#endif /* PPPOE_SUPPORT */
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
 /* Gets data from queue and forwards to LWIP */
 static struct pbuf *lpc_low_level_input(struct netif *netif) {
 	struct lpc_enetdata *lpc_netifdata = netif->state;
@@ -290,6 +522,17 @@ static struct pbuf *lpc_low_level_input(struct netif *netif) {
 		}
 	}
 
+#if LPC_CHECKSUM_OFFLOAD
+	/* lwIP doesn't check checksums, drop here what the MAC or the
+	   software fallback found wrong */
+	if (!rxerr && !lpc_rx_checksum_ok(lpc_netifdata, p, status,
+									  lpc_netifdata->prdesc[ridx].EXTSTAT)) {
+		LINK_STATS_INC(link.chkerr);
+		LINK_STATS_INC(link.drop);
+		rxerr = 1;
+	}
+#endif
+
 	/* Increment free descriptor count and next get index */
 	lpc_netifdata->rx_free_descs++;
 	ridx++;
@@ -315,6 +558,8 @@ static struct pbuf *lpc_low_level_input(struct netif *netif) {
 		p->len = p->tot_len = (u16_t) RDES_FLMSK(status);
 
 		LINK_STATS_INC(link.recv);
+		lpc_netifdata->rx_stats.frames++;
+		lpc_netifdata->rx_stats.bytes += p->len;
 
 		LWIP_DEBUGF(EMAC_DEBUG | LWIP_DBG_TRACE,
 					("lpc_low_level_input: Packet received, %d bytes, "
@@ -362,6 +607,51 @@ static err_t lpc_tx_setup(struct lpc_enetdata *lpc_netifdata)
 	return ERR_OK;
 }
 
+#if NO_SYS == 0
+/* Blocks until dn TX descriptors are free or LPC_TX_WAIT_MS expires.
+   vTransmitCleanupTask gives xTXDCountSem for every descriptor it reclaims.
+   The count can be left over from earlier reclaims, so the free count is
+   checked again after every wakeup */
+static err_t lpc_tx_wait(struct lpc_enetdata *lpc_netifdata, u32_t dn)
+{
+	TickType_t start = xTaskGetTickCount();
+	TickType_t timeout = pdMS_TO_TICKS(LPC_TX_WAIT_MS);
+	u32_t cycles = DWT->CYCCNT;
+	err_t err = ERR_OK;
+	u32_t us;
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	while (dn > lpc_tx_ready(lpc_netifdata->netif)) {
+		TickType_t elapsed = xTaskGetTickCount() - start;
+		if (elapsed >= timeout) {
+			err = ERR_MEM;
+			break;
+		}
+		xSemaphoreTake(lpc_netifdata->xTXDCountSem, timeout - elapsed);
+	}
+
+	us = (DWT->CYCCNT - cycles) / (SystemCoreClock / 1000000);
+
+	SYS_ARCH_PROTECT(lev);
+	lpc_netifdata->tx_stats.stalls++;
+	if (err != ERR_OK) {
+		lpc_netifdata->tx_stats.timeouts++;
+	}
+	lpc_netifdata->tx_stats.wait_us += us;
+	if (us > lpc_netifdata->tx_stats.wait_max_us) {
+		lpc_netifdata->tx_stats.wait_max_us = us;
+	}
+	SYS_ARCH_UNPROTECT(lev);
+
+	if (err != ERR_OK) {
+		LWIP_DEBUGF(EMAC_DEBUG | LWIP_DBG_TRACE,
+					("lpc_tx_wait: no TX descriptors after %d ms, dropping\n",
+					 LPC_TX_WAIT_MS));
+	}
+	return err;
+}
+#endif
+
 /* Low level output of a packet. Never call this from an interrupt context,
    as it may block until TX descriptors become available */
 static err_t lpc_low_level_output(struct netif *netif, struct pbuf *sendp)
@@ -420,12 +710,23 @@ static err_t lpc_low_level_output(struct netif *netif, struct pbuf *sendp)
 	dn = (u32_t) pbuf_clen(p);
 
 	/* Wait until enough descriptors are available for the transfer. */
-	/* THIS WILL BLOCK UNTIL THERE ARE ENOUGH DESCRIPTORS AVAILABLE */
-	while (dn > lpc_tx_ready(netif))
 #if NO_SYS == 0
-	{xSemaphoreTake(lpc_netifdata->xTXDCountSem, 0); }
+	if (dn > lpc_tx_ready(netif)) {
+		if (lpc_tx_wait(lpc_netifdata, dn) != ERR_OK) {
+#if LPC_CHECK_SLOWMEM == 1
+			if (pcopy) {
+				pbuf_free(wp);
+			}
+#endif
+			LINK_STATS_INC(link.drop);
+			return ERR_MEM;
+		}
+	}
 #else
-	{msDelay(1); }
+	/* THIS WILL BLOCK UNTIL THERE ARE ENOUGH DESCRIPTORS AVAILABLE */
+	while (dn > lpc_tx_ready(netif)) {
+		msDelay(1);
+	}
 #endif
 
 	/* Get the next free descriptor index */
@@ -534,20 +835,139 @@ static err_t lpc_etharp_output(struct netif *netif, struct pbuf *q,
 }
 
 #if NO_SYS == 0
+/* Returns if a received frame is waiting in the descriptors. There is
+   nothing to read if every descriptor is empty */
+static int lpc_rx_ready(struct lpc_enetdata *lpc_netifdata)
+{
+	return (lpc_netifdata->rx_free_descs < LPC_NUM_BUFF_RXDESCS) &&
+		   !(lpc_netifdata->prdesc[lpc_netifdata->rx_get_idx].STATUS & RDES_OWN);
+}
+
+/* Masks or unmasks the RX interrupts. ETH_IRQHandler masks them when it
+   wakes up the receive task, the task unmasks them once drained */
+static void lpc_rx_int_enable(int enable)
+{
+	taskENTER_CRITICAL();
+	if (enable) {
+		LPC_ETHERNET->DMA_INT_EN |= DMA_IE_RIE | DMA_IE_RUE;
+	}
+	else {
+		LPC_ETHERNET->DMA_INT_EN &= ~(DMA_IE_RIE | DMA_IE_RUE);
+	}
+	taskEXIT_CRITICAL();
+}
+
+/* Inputs the frames batched by the receive task, runs in the tcpip
+   thread. The posted flag is cleared first so a frame added while
+   draining is either seen here or posts a new batch */
+static void lpc_rx_batch_input(void *arg)
+{
+	struct lpc_enetdata *lpc_netifdata = arg;
+	struct pbuf *p;
+	u32_t tail;
+
+	lpc_netifdata->rx_batch_posted = 0;
+
+	tail = lpc_netifdata->rx_batch_tail;
+	while (tail != lpc_netifdata->rx_batch_head) {
+		p = lpc_netifdata->rx_batch[tail];
+		if (++tail > LPC_NUM_RX_PBUFS) {
+			tail = 0;
+		}
+		lpc_netifdata->rx_batch_tail = tail;
+
+		/* What tcpip_input() would do for an ethernet netif */
+		if (ethernet_input(p, lpc_netifdata->netif) != ERR_OK) {
+			pbuf_free(p);
+		}
+	}
+}
+
+/* Reads up to budget frames from the descriptors and passes them to the
+   tcpip thread with a single message. rx_batch can't overflow, it has
+   room for every RX buffer */
+static u32_t lpc_rx_drain(struct lpc_enetdata *lpc_netifdata, u32_t budget)
+{
+	struct pbuf *p;
+	u32_t frames = 0;
+	u32_t head = lpc_netifdata->rx_batch_head;
+
+	while ((frames < budget) && lpc_rx_ready(lpc_netifdata)) {
+		frames++;
+
+		p = lpc_low_level_input(lpc_netifdata->netif);
+		if (p == NULL) {
+			continue;
+		}
+		if (!lpc_rx_ethertype_ok(p)) {
+			pbuf_free(p);
+			continue;
+		}
+
+		lpc_netifdata->rx_batch[head] = p;
+		if (++head > LPC_NUM_RX_PBUFS) {
+			head = 0;
+		}
+		lpc_netifdata->rx_batch_head = head;
+	}
+
+	if ((lpc_netifdata->rx_batch_tail != head) &&
+		!lpc_netifdata->rx_batch_posted) {
+		lpc_netifdata->rx_batch_posted = 1;
+		/* Out of MEMP_TCPIP_MSG_API messages. Nothing else would post the
+		   queued frames until the next RX interrupt, so wait for one */
+		while (tcpip_callback_with_block(lpc_rx_batch_input, lpc_netifdata, 1)
+			   != ERR_OK) {
+			vTaskDelay(1);
+		}
+	}
+
+	return frames;
+}
+
 /* Packet reception task
-   This task is called when a packet is received. It will
-   pass the packet to the LWIP core */
+   This task is woken up by the first received packet, with the RX
+   interrupts masked. It drains the descriptors in batches of up to
+   LPC_RX_BUDGET frames and unmasks the interrupts when they are empty */
 static void vPacketReceiveTask(void *pvParameters) {
 	struct lpc_enetdata *lpc_netifdata = pvParameters;
+	u32_t frames, n;
+	SYS_ARCH_DECL_PROTECT(lev);
 
 	while (1) {
 		/* Wait for receive task to wakeup */
 		sys_arch_sem_wait(&lpc_netifdata->RxSem, 0);
 
-		/* Process receive packets */
-		while (!(lpc_netifdata->prdesc[lpc_netifdata->rx_get_idx].STATUS
-				 & RDES_OWN)) {
-			lpc_enetif_input(lpc_netifdata->netif);
+		/* Give the buffers lwIP returned to the descriptors left empty
+		   while the ring was starved, lpc_rx_pbuf_free() wakes us up */
+		lpc_rx_queue(lpc_netifdata->netif);
+
+		frames = 0;
+		while (1) {
+			n = lpc_rx_drain(lpc_netifdata, LPC_RX_BUDGET);
+			frames += n;
+			if (n == LPC_RX_BUDGET) {
+				/* Budget used up, let the tcpip thread catch up */
+				taskYIELD();
+				continue;
+			}
+
+			/* Unmask, then look again for a frame that came in before the
+			   interrupt was enabled */
+			lpc_rx_int_enable(1);
+			if (!lpc_rx_ready(lpc_netifdata)) {
+				break;
+			}
+			lpc_rx_int_enable(0);
+		}
+
+		if (frames) {
+			SYS_ARCH_PROTECT(lev);
+			lpc_netifdata->rx_stats.wakeups++;
+			if (frames > lpc_netifdata->rx_stats.batch_max) {
+				lpc_netifdata->rx_stats.batch_max = frames;
+			}
+			SYS_ARCH_UNPROTECT(lev);
 		}
 	}
 }
@@ -580,6 +1000,12 @@ static err_t low_level_init(struct netif *netif)
 	/* Save MAC address */
 	Chip_ENET_SetADDR(LPC_ETHERNET, netif->hwaddr);
 
+#if LPC_CHECKSUM_OFFLOAD
+	/* The RX checksum results are written to the second half of the
+	   enhanced descriptors */
+	LPC_ETHERNET->DMA_BUS_MODE |= DMA_BM_ATDS;
+#endif
+
 	/* Initial MAC configuration for checksum offload, full duplex,
 	   100Mbps, disable receive own in half duplex, inter-frame gap
 	   of 64-bits */
@@ -625,6 +1051,12 @@ static err_t low_level_init(struct netif *netif)
 	   64 bytes */
 	LPC_ETHERNET->DMA_OP_MODE |= DMA_OM_RTC(1) | DMA_OM_TTC(0);
 
+#if LPC_CHECKSUM_OFFLOAD
+	/* The MAC only inserts the checksums of frames it holds entirely,
+	   transmit in store and forward mode */
+	LPC_ETHERNET->DMA_OP_MODE |= DMA_OM_TSF;
+#endif
+
 	/* Clear all MAC interrupts */
 	LPC_ETHERNET->DMA_STAT = DMA_ST_ALL;
 
@@ -662,23 +1094,17 @@ s32_t lpc_rx_queue(struct netif *netif)
 
 	/* Attempt to requeue as many packets as possible */
 	while (lpc_netifdata->rx_free_descs > 0) {
-		/* Allocate a pbuf from the pool. We need to allocate at the
-		   maximum size as we don't know the size of the yet to be
-		   received packet. */
-		p = pbuf_alloc(PBUF_RAW, (u16_t) EMAC_ETH_MAX_FLEN, PBUF_RAM);
+		/* Take a buffer from the ring. It covers the maximum size as
+		   we don't know the size of the yet to be received packet. */
+		p = lpc_rx_pbuf_alloc(lpc_netifdata);
 		if (p == NULL) {
 			LWIP_DEBUGF(EMAC_DEBUG | LWIP_DBG_TRACE,
-						("lpc_rx_queue: could not allocate RX pbuf index %d, "
+						("lpc_rx_queue: no free RX buffer for index %d, "
 						 "free %d)\n", lpc_netifdata->rx_next_idx,
 						 lpc_netifdata->rx_free_descs));
 			return queued;
 		}
 
-		/* pbufs allocated from the RAM pool should be non-chained (although
-		   the hardware will allow chaining) */
-		LWIP_ASSERT("lpc_rx_queue: pbuf is not contiguous (chained)",
-					pbuf_clen(p) <= 1);
-
 		/* Queue packet */
 		lpc_rxqueue_pbuf(lpc_netifdata, p);
 
@@ -689,11 +1115,29 @@ s32_t lpc_rx_queue(struct netif *netif)
 	return queued;
 }
 
+/* Returns the receive counters */
+void lpc_rx_get_stats(struct lpc_rx_stats *stats)
+{
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	*stats = lpc_enetdata.rx_stats;
+	SYS_ARCH_UNPROTECT(lev);
+}
+
+/* Returns the transmit backpressure counters */
+void lpc_tx_get_stats(struct lpc_tx_stats *stats)
+{
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	*stats = lpc_enetdata.tx_stats;
+	SYS_ARCH_UNPROTECT(lev);
+}
+
 /* Attempt to read a packet from the EMAC interface */
 void lpc_enetif_input(struct netif *netif)
 {
-	struct eth_hdr *ethhdr;
-
 	struct pbuf *p;
 
 	/* move received packet into a new pbuf */
@@ -702,29 +1146,18 @@ void lpc_enetif_input(struct netif *netif)
 		return;
 	}
 
-	/* points to packet payload, which starts with an Ethernet header */
-	ethhdr = p->payload;
-
-	switch (htons(ethhdr->type)) {
-	case ETHTYPE_IP:
-	case ETHTYPE_ARP:
-#if PPPOE_SUPPORT
-	case ETHTYPE_PPPOEDISC:
-	case ETHTYPE_PPPOE:
-#endif /* PPPOE_SUPPORT */
-		/* full packet send to tcpip_thread to process */
-		if (netif->input(p, netif) != ERR_OK) {
-			LWIP_DEBUGF(NETIF_DEBUG,
-						("lpc_enetif_input: IP input error\n"));
-			/* Free buffer */
-			pbuf_free(p);
-		}
-		break;
-
-	default:
+	if (!lpc_rx_ethertype_ok(p)) {
 		/* Return buffer */
 		pbuf_free(p);
-		break;
+		return;
+	}
+
+	/* full packet send to tcpip_thread to process */
+	if (netif->input(p, netif) != ERR_OK) {
+		LWIP_DEBUGF(NETIF_DEBUG,
+					("lpc_enetif_input: IP input error\n"));
+		/* Free buffer */
+		pbuf_free(p);
 	}
 }
 
@@ -826,16 +1259,18 @@ void ETH_IRQHandler(void)
 
 	/* RX group interrupt(s) */
 	if (ints & (DMA_ST_RI | DMA_ST_OVF | DMA_ST_RU)) { /* RU: Receive Buffer Unavailable */
-		/* Give semaphore to wakeup RX receive task. Note the FreeRTOS
-		   method is used instead of the LWIP arch method. */
-		xSemaphoreGiveFromISR(lpc_enetdata.RxSem, &xRecTaskWoken);
+		/* Mask further RX interrupts, the receive task polls the
+		   descriptors until they are empty and unmasks them */
+		LPC_ETHERNET->DMA_INT_EN &= ~(DMA_IE_RIE | DMA_IE_RUE);
+
+		/* Give semaphore to wakeup RX receive task */
+		sys_sem_signal_from_isr(&lpc_enetdata.RxSem, &xRecTaskWoken);
 	}
 
 	/* TX group interrupt(s) */
 	if (ints & (DMA_ST_TI | DMA_ST_UNF | DMA_ST_TU)) {
-		/* Give semaphore to wakeup TX cleanup task. Note the FreeRTOS
-		   method is used instead of the LWIP arch method. */
-		xSemaphoreGiveFromISR(lpc_enetdata.TxCleanSem, &XTXTaskWoken);
+		/* Give semaphore to wakeup TX cleanup task */
+		sys_sem_signal_from_isr(&lpc_enetdata.TxCleanSem, &XTXTaskWoken);
 	}
 
 	/* Clear pending interrupts */
@@ -909,8 +1344,9 @@ err_t lpc_enetif_init(struct netif *netif)
 
 	/* For FreeRTOS, start tasks */
 #if NO_SYS == 0
-	lpc_enetdata.xTXDCountSem = xSemaphoreCreateCounting(LPC_NUM_BUFF_TXDESCS,
-														 LPC_NUM_BUFF_TXDESCS);
+	lpc_enetdata.xTXDCountSem = rtos_semaphore_create_counting(LPC_NUM_BUFF_TXDESCS,
+															   0,
+															   RTOS_BANK_RAMLOC32);
 	LWIP_ASSERT("xTXDCountSem creation error",
 				(lpc_enetdata.xTXDCountSem != NULL));
 
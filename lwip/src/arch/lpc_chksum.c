@@ -0,0 +1,159 @@
+/*
+ * @brief Internet checksum for the Cortex-M4
+ *
+ * @note
+ * Plugged into lwIP as LWIP_CHKSUM from cc.h when LPC_CHKSUM is set.
+ * Returns the same value as the reference lwip_standard_chksum(), the non
+ * inverted sum in the byte order lwIP expects, so inet_chksum_pseudo() can
+ * combine the pbufs of a chain as it does with the reference routines.
+ * tools/chksum_bench compares both on odd offsets and lengths.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/inet_chksum.h"
+
+/** @defgroup NET_LWIP_CHKSUM LWIP checksum routine
+ * @ingroup NET_LWIP
+ * Word wide Internet checksum for the Cortex-M4
+ * @{
+ */
+
+#if BYTE_ORDER != LITTLE_ENDIAN
+#error lpc_chksum() assumes a little endian CPU
+#endif
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+#if defined(__GNUC__) && defined(__ARM_ARCH_7EM__)
+/* Adds 32 bytes to the sum, the carries are added back by the ADCS chain.
+   Back to back LDRs pipeline on the M4, so this costs about 17 cycles */
+static inline u32_t lpc_chksum_block32(u32_t sum, const u32_t **pw)
+{
+	u32_t a, b, c, d;
+
+	__asm volatile (
+		"ldr	%[a], [%[p]], #4\n\t"
+		"ldr	%[b], [%[p]], #4\n\t"
+		"ldr	%[c], [%[p]], #4\n\t"
+		"ldr	%[d], [%[p]], #4\n\t"
+		"adds	%[s], %[s], %[a]\n\t"
+		"adcs	%[s], %[s], %[b]\n\t"
+		"adcs	%[s], %[s], %[c]\n\t"
+		"adcs	%[s], %[s], %[d]\n\t"
+		"ldr	%[a], [%[p]], #4\n\t"
+		"ldr	%[b], [%[p]], #4\n\t"
+		"ldr	%[c], [%[p]], #4\n\t"
+		"ldr	%[d], [%[p]], #4\n\t"
+		"adcs	%[s], %[s], %[a]\n\t"
+		"adcs	%[s], %[s], %[b]\n\t"
+		"adcs	%[s], %[s], %[c]\n\t"
+		"adcs	%[s], %[s], %[d]\n\t"
+		"adc	%[s], %[s], #0"
+		: [s] "+r" (sum), [p] "+r" (*pw),
+		  [a] "=&r" (a), [b] "=&r" (b), [c] "=&r" (c), [d] "=&r" (d)
+		:
+		: "cc", "memory");
+	return sum;
+}
+
+/* Adds one word to the sum with end around carry */
+static inline u32_t lpc_chksum_word(u32_t sum, u32_t w)
+{
+	__asm volatile (
+		"adds	%[s], %[s], %[w]\n\t"
+		"adc	%[s], %[s], #0"
+		: [s] "+r" (sum)
+		: [w] "r" (w)
+		: "cc");
+	return sum;
+}
+#else
+/* Portable versions, used when building for anything but the M4 */
+static inline u32_t lpc_chksum_word(u32_t sum, u32_t w)
+{
+	uint64_t acc = (uint64_t) sum + w;
+	return (u32_t) acc + (u32_t) (acc >> 32);
+}
+
+static inline u32_t lpc_chksum_block32(u32_t sum, const u32_t **pw)
+{
+	const u32_t *p = *pw;
+	uint64_t acc = sum;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		acc += p[i];
+	}
+	*pw = p + 8;
+
+	acc = (acc & 0xffffffffULL) + (acc >> 32);
+	return (u32_t) acc + (u32_t) (acc >> 32);
+}
+#endif
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+/* Internet checksum of a buffer at any alignment */
+u16_t lpc_chksum(const void *dataptr, int len)
+{
+	const u8_t *pb = (const u8_t *) dataptr;
+	const u32_t *pw;
+	u32_t sum = 0;
+	int odd = ((mem_ptr_t) pb & 1);
+
+	/* An odd start is summed one byte shifted, the swap at the end puts
+	   every byte back in its lane */
+	if (odd && (len > 0)) {
+		sum = (u32_t) *pb++ << 8;
+		len--;
+	}
+
+	/* Get aligned to u32_t */
+	if (((mem_ptr_t) pb & 2) && (len > 1)) {
+		sum += *(const u16_t *) (const void *) pb;
+		pb += 2;
+		len -= 2;
+	}
+
+	/* Add the bulk of the data a word at a time */
+	pw = (const u32_t *) (const void *) pb;
+	while (len >= 32) {
+		sum = lpc_chksum_block32(sum, &pw);
+		len -= 32;
+	}
+	while (len >= 4) {
+		sum = lpc_chksum_word(sum, *pw++);
+		len -= 4;
+	}
+
+	/* Fold so the trailing bytes can't overflow */
+	sum = FOLD_U32T(sum);
+
+	pb = (const u8_t *) pw;
+	if (len > 1) {
+		sum += *(const u16_t *) (const void *) pb;
+		pb += 2;
+		len -= 2;
+	}
+	if (len > 0) {
+		sum += *pb;
+	}
+
+	sum = FOLD_U32T(sum);
+	sum = FOLD_U32T(sum);
+
+	/* Swap if alignment was odd */
+	if (odd) {
+		sum = SWAP_BYTES_IN_WORD(sum);
+	}
+
+	return (u16_t) sum;
+}
+
+/**
+ * @}
+ */
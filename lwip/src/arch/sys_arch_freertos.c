@@ -36,6 +36,7 @@
 #include "lwip/mem.h"
 
 #include "arch/lpc_arch.h"
+#include "rtos_static.h"
 #include <stdio.h>
 
  #if NO_SYS==0
@@ -257,6 +258,110 @@ unsigned long ulReturn;
 	return ulReturn;
 }
 
+#if SYS_ARCH_SEM_NOTIFY
+/*---------------------------------------------------------------------------*
+ * Routine:  sys_sem_new
+ *---------------------------------------------------------------------------*
+ * Description:
+ *      Creates and returns a new semaphore. The "ucCount" argument specifies
+ *      the initial state of the semaphore.
+ *      The semaphore is a count and the task waiting on it, the waiter is
+ *      woken with SYS_SEM_NOTIFY_BIT, so signaling and waiting don't go
+ *      through the queue code.
+ * Inputs:
+ *      sys_sem_t *sem          -- Semaphore to create
+ *      u8_t ucCount              -- Initial ucCount of semaphore (1 or 0)
+ * Outputs:
+ *      err_t                   -- ERR_OK, or ERR_MEM if could not create.
+ *---------------------------------------------------------------------------*/
+err_t sys_sem_new( sys_sem_t *pxSemaphore, u8_t ucCount )
+{
+err_t xReturn = ERR_MEM;
+
+	*pxSemaphore = pvPortMalloc( sizeof( struct sys_sem ) );
+
+	if( *pxSemaphore != NULL )
+	{
+		( *pxSemaphore )->xWaiter = NULL;
+		( *pxSemaphore )->ucCount = ( ucCount != 0U );
+
+		xReturn = ERR_OK;
+		SYS_STATS_INC_USED( sem );
+	}
+	else
+	{
+		SYS_STATS_INC( sem.err );
+	}
+
+	return xReturn;
+}
+
+/*---------------------------------------------------------------------------*
+ * Routine:  sys_arch_sem_wait
+ *---------------------------------------------------------------------------*
+ * Description:
+ *      Blocks the thread while waiting for the semaphore to be
+ *      signaled, see the queue based version below for the return values.
+ *
+ *      The count is the state of the semaphore, the notification only wakes
+ *      the waiter up, so it is checked again after every wake up. Other
+ *      users of the task notification (ulTaskNotifyTake()) don't clear
+ *      SYS_SEM_NOTIFY_BIT and the notifications they give are kept, at
+ *      most they see a spurious wake up.
+ * Inputs:
+ *      sys_sem_t sem           -- Semaphore to wait on
+ *      u32_t timeout           -- Number of milliseconds until timeout
+ * Outputs:
+ *      u32_t                   -- Time elapsed or SYS_ARCH_TIMEOUT.
+ *---------------------------------------------------------------------------*/
+u32_t sys_arch_sem_wait( sys_sem_t *pxSemaphore, u32_t ulTimeout )
+{
+struct sys_sem *pxSem = *pxSemaphore;
+TickType_t xStartTime, xElapsed, xTicks;
+unsigned long ulReturn;
+
+	xStartTime = xTaskGetTickCount();
+	xTicks = ulTimeout / portTICK_PERIOD_MS;
+
+	for( ;; )
+	{
+		taskENTER_CRITICAL();
+		xElapsed = xTaskGetTickCount() - xStartTime;
+
+		if( pxSem->ucCount != 0U )
+		{
+			pxSem->ucCount = 0U;
+			pxSem->xWaiter = NULL;
+			taskEXIT_CRITICAL();
+			break;
+		}
+
+		if( ( ulTimeout != 0UL ) && ( xElapsed >= xTicks ) )
+		{
+			pxSem->xWaiter = NULL;
+			taskEXIT_CRITICAL();
+			return SYS_ARCH_TIMEOUT;
+		}
+
+		LWIP_ASSERT( "sys_arch_sem_wait: more than one waiter",
+				( pxSem->xWaiter == NULL ) || ( pxSem->xWaiter == xTaskGetCurrentTaskHandle() ) );
+		pxSem->xWaiter = xTaskGetCurrentTaskHandle();
+		taskEXIT_CRITICAL();
+
+		xTaskNotifyWait( 0UL, SYS_SEM_NOTIFY_BIT, NULL,
+				( ulTimeout != 0UL ) ? ( xTicks - xElapsed ) : portMAX_DELAY );
+	}
+
+	ulReturn = xElapsed * portTICK_PERIOD_MS;
+
+	if( ( ulTimeout == 0UL ) && ( ulReturn == 0UL ) )
+	{
+		ulReturn = 1UL;
+	}
+
+	return ulReturn;
+}
+#else
 /*---------------------------------------------------------------------------*
  * Routine:  sys_sem_new
  *---------------------------------------------------------------------------*
@@ -353,6 +458,7 @@ unsigned long ulReturn;
 
 	return ulReturn;
 }
+#endif /* SYS_ARCH_SEM_NOTIFY */
 
 /**
  * @brief	Create a new mutex
@@ -402,6 +508,67 @@ void sys_mutex_free( sys_mutex_t *pxMutex )
 }
 
 
+#if SYS_ARCH_SEM_NOTIFY
+/*---------------------------------------------------------------------------*
+ * Routine:  sys_sem_signal
+ *---------------------------------------------------------------------------*
+ * Description:
+ *      Signals (releases) a semaphore, waking up its waiter if any
+ * Inputs:
+ *      sys_sem_t sem           -- Semaphore to signal
+ *---------------------------------------------------------------------------*/
+void sys_sem_signal( sys_sem_t *pxSemaphore )
+{
+struct sys_sem *pxSem = *pxSemaphore;
+
+	taskENTER_CRITICAL();
+	pxSem->ucCount = 1U;
+
+	if( pxSem->xWaiter != NULL )
+	{
+		xTaskNotify( pxSem->xWaiter, SYS_SEM_NOTIFY_BIT, eSetBits );
+	}
+	taskEXIT_CRITICAL();
+}
+
+/*---------------------------------------------------------------------------*
+ * Routine:  sys_sem_signal_from_isr
+ *---------------------------------------------------------------------------*
+ * Description:
+ *      Signals (releases) a semaphore from an interrupt handler
+ * Inputs:
+ *      sys_sem_t sem           -- Semaphore to signal
+ *      BaseType_t *woken       -- Set to pdTRUE if a context switch is needed
+ *---------------------------------------------------------------------------*/
+void sys_sem_signal_from_isr( sys_sem_t *pxSemaphore, BaseType_t *pxHigherPriorityTaskWoken )
+{
+struct sys_sem *pxSem = *pxSemaphore;
+UBaseType_t uxSavedInterruptStatus;
+
+	uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	pxSem->ucCount = 1U;
+
+	if( pxSem->xWaiter != NULL )
+	{
+		xTaskNotifyFromISR( pxSem->xWaiter, SYS_SEM_NOTIFY_BIT, eSetBits, pxHigherPriorityTaskWoken );
+	}
+	taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*---------------------------------------------------------------------------*
+ * Routine:  sys_sem_free
+ *---------------------------------------------------------------------------*
+ * Description:
+ *      Deallocates a semaphore
+ * Inputs:
+ *      sys_sem_t sem           -- Semaphore to free
+ *---------------------------------------------------------------------------*/
+void sys_sem_free( sys_sem_t *pxSemaphore )
+{
+	SYS_STATS_DEC(sem.used);
+	vPortFree( *pxSemaphore );
+}
+#else
 /*---------------------------------------------------------------------------*
  * Routine:  sys_sem_signal
  *---------------------------------------------------------------------------*
@@ -429,6 +596,21 @@ void sys_sem_free( sys_sem_t *pxSemaphore )
 	vQueueDelete( *pxSemaphore );
 }
 
+/*---------------------------------------------------------------------------*
+ * Routine:  sys_sem_signal_from_isr
+ *---------------------------------------------------------------------------*
+ * Description:
+ *      Signals (releases) a semaphore from an interrupt handler
+ * Inputs:
+ *      sys_sem_t sem           -- Semaphore to signal
+ *      BaseType_t *woken       -- Set to pdTRUE if a context switch is needed
+ *---------------------------------------------------------------------------*/
+void sys_sem_signal_from_isr( sys_sem_t *pxSemaphore, BaseType_t *pxHigherPriorityTaskWoken )
+{
+	xSemaphoreGiveFromISR( *pxSemaphore, pxHigherPriorityTaskWoken );
+}
+#endif /* SYS_ARCH_SEM_NOTIFY */
+
 /*---------------------------------------------------------------------------*
  * Routine:  sys_init
  *---------------------------------------------------------------------------*
@@ -464,22 +646,8 @@ u32_t sys_now(void)
  *---------------------------------------------------------------------------*/
 sys_thread_t sys_thread_new( const char *pcName, void( *pxThread )( void *pvParameters ), void *pvArg, int iStackSize, int iPriority )
 {
-	TaskHandle_t xCreatedTask;
-	BaseType_t xResult;
-	sys_thread_t xReturn;
-
-	xResult = xTaskCreate( pxThread, pcName, iStackSize, pvArg, iPriority, &xCreatedTask );
-
-	if( xResult == pdPASS )
-	{
-		xReturn = xCreatedTask;
-	}
-	else
-	{
-		xReturn = NULL;
-	}
-
-	return xReturn;
+	/* lwIP threads live until the next reset */
+	return rtos_task_create( pxThread, pcName, iStackSize, pvArg, iPriority, RTOS_LWIP_BANK );
 }
 
 /*---------------------------------------------------------------------------*
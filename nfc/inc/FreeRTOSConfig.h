@@ -16,6 +16,12 @@
  * FreeRTOS API DOCUMENTATION AVAILABLE ON THE FreeRTOS.org WEB SITE.
  *----------------------------------------------------------*/
 
+/* Set to 1 to create the boot time tasks, queues and semaphores from the
+ * static pools in rtos_static.c instead of the heap */
+#ifndef configSUPPORT_STATIC_ALLOCATION
+#define configSUPPORT_STATIC_ALLOCATION	0
+#endif
+
 #define configUSE_PREEMPTION		1
 #define configUSE_IDLE_HOOK			0
 #define configMAX_PRIORITIES		5
@@ -23,7 +29,10 @@
 #define configCPU_CLOCK_HZ			( ( uint32_t ) SystemCoreClock )
 #define configTICK_RATE_HZ			( ( TickType_t ) 1000 )
 #define configMINIMAL_STACK_SIZE	( ( uint16_t ) 128 )
-#ifdef __CODE_RED
+#if defined(__CODE_RED) && (configSUPPORT_STATIC_ALLOCATION == 1)
+/* Task stacks come from the static pools in rtos_static.c, which share RamLoc40 */
+#define configTOTAL_HEAP_SIZE		( ( size_t ) ( 20*1024 ) )
+#elif defined(__CODE_RED)
 #define configTOTAL_HEAP_SIZE		( ( size_t ) ( 40*1024 ) ) /* GPa 201118 1610 Estaba en 32*1024 */
 #else
 #define configTOTAL_HEAP_SIZE		( ( size_t ) ( 0 ) )
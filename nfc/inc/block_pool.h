@@ -0,0 +1,47 @@
+#ifndef BLOCK_POOL_H_
+#define BLOCK_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Size classes, smallest first. Block sizes must be multiples of
+ * portBYTE_ALIGNMENT */
+#define BLOCK_POOL_CLASSES		4
+#define BLOCK_POOL_SIZES		{ 32, 64, 128, 256 }
+#define BLOCK_POOL_CLASS_BYTES	(2 * 1024)	/* Static memory of every class */
+
+/**
+ * @struct 	block_pool_stats
+ * @brief	usage counters of a size class.
+ */
+struct block_pool_stats {
+	uint16_t block_size;
+	uint16_t blocks;
+	uint16_t in_use;
+	uint16_t high_water;		/* Max blocks in use at once */
+	uint32_t allocs;			/* Allocations served by this class since boot */
+	uint32_t overflows;			/* Allocations that found the class empty */
+};
+
+void block_pool_init(void);
+
+void *block_pool_malloc(size_t size);
+
+void block_pool_free(void *ptr);
+
+bool block_pool_owns(void const *ptr);
+
+void block_pool_get_stats(struct block_pool_stats stats[BLOCK_POOL_CLASSES]);
+
+uint32_t block_pool_heap_allocs(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BLOCK_POOL_H_ */
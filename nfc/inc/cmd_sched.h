@@ -0,0 +1,41 @@
+#ifndef CMD_SCHED_H_
+#define CMD_SCHED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "parson.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CMD_SCHED_MAX			8	/* Pending plus not yet reported commands */
+#define CMD_SCHED_NAME_LEN		32
+
+/* Results not reported by then are dropped, so they can't fill the
+   schedule or reach a later client */
+#define CMD_SCHED_RESULT_TTL_MS	10000
+
+/* Longest "delay" accepted, pdMS_TO_TICKS() must not overflow */
+#define CMD_SCHED_MAX_DELAY_MS	600000
+
+void cmd_sched_init(void);
+
+JSON_Value *cmd_sched_add(char const *cmd, JSON_Value const *pars,
+		TickType_t at_tick);
+
+uint32_t cmd_sched_ms_to_next_result(void);
+
+bool cmd_sched_defer(void (*fn)(void *arg), void *arg);
+
+JSON_Value *cmd_sched_results_json(void);
+
+void cmd_sched_results_drop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CMD_SCHED_H_ */
@@ -39,6 +39,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -83,9 +84,17 @@ static inline const char* levelText(enum debugLevels level)
 extern enum debugLevels debugLocalLevel;
 extern enum debugLevels debugNetLevel;
 extern SemaphoreHandle_t uart_mutex;
-extern QueueHandle_t debug_queue;
 extern bool debug_to_network;
 
+#define DEBUG_RING_LEN			32	/* Records, must be a power of 2 */
+#define DEBUG_RECORD_MAX_ARGS	6	/* 32 bit words, doubles take two */
+#define DEBUG_RECORD_STR_LEN	48	/* Room for the copies of the %s arguments,
+									   three dotted addresses. Longer ones end
+									   in DEBUG_STR_TRUNCATED */
+
+#define DEBUG_NET_RING_LEN		32	/* Formatted lines kept for the network, power of 2 */
+#define DEBUG_NET_LINE_LEN		120
+
 /**
  * The file where debug output is written. Defaults to <tt>stderr</tt>.
  * <tt>debugToFile()</tt> allows output to any file.
@@ -94,6 +103,12 @@ extern FILE *debugFile;
 
 void debugInit(void);
 
+uint32_t debugDropped(void);
+
+bool debugNetRead(uint32_t *seq, char *line, size_t size);
+
+void debugNetSetListener(TaskHandle_t task);
+
 void debugLocalSetLevel(enum debugLevels lvl);
 
 void debugNetSetLevel(enum debugLevels lvl);
@@ -133,63 +148,86 @@ void debugClose(void);
 /** Simple alias for <tt>lDebug()</tt> */
 #define debug(fmt, ...) lDebug(1, fmt, ##__VA_ARGS__)
 
-static inline char* make_message(const char *fmt, ...)
-{
-	int size = 0;
-	char *p = NULL;
-	va_list ap;
+/**
+ * @struct 	debugModule
+ * @brief	a source file that defined LOG_MODULE_NAME, with its runtime level.
+ */
+struct debugModule {
+	const char *name;
+	enum debugLevels compiled;	/* LOG_MODULE_LEVEL, lower call sites are gone */
+	int level;					/* DEBUG_MODULE_DEFAULT or the override */
+	struct debugModule *next;
+};
 
-	/* Determine required size */
+#define DEBUG_MODULE_DEFAULT	(-1)	/* Use debugLocalLevel and debugNetLevel */
 
-	va_start(ap, fmt);
-	size = vsnprintf(p, size, fmt, ap);
-	va_end(ap);
+void debugModuleRegister(struct debugModule *module);
 
-	if (size < 0)
-		return NULL;
+struct debugModule *debugModuleFind(const char *name);
 
-	size++; /* For '\0' */
-	p = pvPortMalloc(size);
-	if (p == NULL)
-		return NULL;
+struct debugModule *debugModuleFirst(void);
 
-	va_start(ap, fmt);
-	size = vsnprintf(p, size, fmt, ap);
-	if (size < 0) {
-		vPortFree(p);
-		return NULL;
-	}
-	va_end(ap);
+/**
+ * Minimum level compiled into the current source file. Call sites with a lower
+ * level are removed by the compiler, arguments included. Define it before
+ * including any header to change it.
+ */
+#ifndef LOG_MODULE_LEVEL
+#define LOG_MODULE_LEVEL	Debug
+#endif
+
+/**
+ * Source files that define LOG_MODULE_NAME before including any header get
+ * a runtime level override, see debugModuleFind(). Their init function must
+ * call debugModuleThisRegister(), the startup code runs no constructors.
+ */
+#ifdef LOG_MODULE_NAME
+static struct debugModule debugModuleThis __attribute__((unused)) = {
+LOG_MODULE_NAME, LOG_MODULE_LEVEL, DEBUG_MODULE_DEFAULT, NULL };
+
+#define debugModuleThisRegister()	debugModuleRegister(&debugModuleThis)
+#define LOG_MODULE		(&debugModuleThis)
+#else
+#define LOG_MODULE		((struct debugModule *) NULL)
+#endif
 
-	return p;
+/**
+ * @brief 	returns if a message would be printed locally or sent to the network,
+ * 			so the arguments aren't captured for nothing.
+ * @param 	*module	:module of the message, NULL if none
+ * @param 	level 	:level of the message
+ */
+static inline bool debugEnabled(const struct debugModule *module,
+		enum debugLevels level)
+{
+	if (module && (module->level != DEBUG_MODULE_DEFAULT)) {
+		return (int) level >= module->level;
+	}
+	return (debugLocalLevel <= level)
+			|| (debug_to_network && (debugNetLevel <= level)
+					&& (level != InfoLocal));
 }
 
+void debugLog(const struct debugModule *module, enum debugLevels level,
+		const char *file, int line, const char *func, const char *fmt, ...)
+		__attribute__((format(printf, 6, 7)));
+
 /**
  * @brief prints this message if the variable <tt>debugLevel</tt> is greater
  * than or equal to the parameter.
+ * @details the message isn't formatted here. The tick, level, location, format
+ * pointer and raw arguments are stored in a lock-free ring, and formatted later
+ * by a low priority task. It can be used from ISRs.
  * @param level the level at which this information should be printed
  * @param fmt the formatting string (<b>MUST</b> be a literal
  */
 #define lDebug(level, fmt, ...) \
 do { \
-		if (DEBUG_ENABLED && (debugLocalLevel <= level)) { \
-			if (uart_mutex != NULL) {	\
-				if (xSemaphoreTake(uart_mutex, portMAX_DELAY) == pdTRUE) { \
-					printf("%lu - %s %s[%d] %s() " fmt "\n", xTaskGetTickCount(), \
-					levelText(level), __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
-					xSemaphoreGive(uart_mutex); \
-				} \
-			} \
-       }\
-	   \
-	   if (DEBUG_ENABLED && debug_to_network && (debugNetLevel <= level) && (level != InfoLocal)) {\
-		   	char *dbg_msg = make_message("%u - %s %s[%d] %s() " fmt, xTaskGetTickCount(), \
-				levelText(level), __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
-			if (xQueueSend(debug_queue, &dbg_msg, (TickType_t) 0) != pdPASS) { \
-				vPortFree(dbg_msg); \
-				dbg_msg = NULL; \
-			} \
-	   } \
+		if (DEBUG_ENABLED && ((level) >= LOG_MODULE_LEVEL) \
+				&& debugEnabled(LOG_MODULE, level)) { \
+			debugLog(LOG_MODULE, level, __FILE__, __LINE__, __func__, fmt, \
+					##__VA_ARGS__); \
+		} \
 } while(0)
 
 #ifdef __cplusplus
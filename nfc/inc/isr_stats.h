@@ -0,0 +1,74 @@
+#ifndef ISR_STATS_H_
+#define ISR_STATS_H_
+
+#include <stdint.h>
+
+#include "board.h"
+#include "parson.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Set to 0 to remove the measurement from the ISRs */
+#ifndef ISR_STATS_ENABLE
+#define ISR_STATS_ENABLE	1
+#endif
+
+enum isr_stats_id {
+	ISR_STATS_TIMER1,		/* X axis step generator */
+	ISR_STATS_TIMER2,		/* Y axis step generator */
+	ISR_STATS_TIMER3,		/* Z axis step generator */
+	ISR_STATS_GPIO0,		/* Encoder Z */
+	ISR_STATS_GPIO1,		/* Encoder B */
+	ISR_STATS_GPIO2,		/* Encoder A */
+	ISR_STATS_COUNT,
+};
+
+/**
+ * @struct 	isr_stats
+ * @brief	cycles spent in an ISR body, measured with the DWT cycle counter.
+ * 			Exception entry and exit are not included.
+ */
+struct isr_stats {
+	uint32_t count;
+	uint32_t last;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+};
+
+extern struct isr_stats isr_stats[ISR_STATS_COUNT];
+
+#if ISR_STATS_ENABLE
+#define ISR_STATS_ENTER()		uint32_t isr_stats_start = DWT->CYCCNT
+#define ISR_STATS_EXIT(id)		isr_stats_record((id), DWT->CYCCNT - isr_stats_start)
+#else
+#define ISR_STATS_ENTER()
+#define ISR_STATS_EXIT(id)
+#endif
+
+static inline void isr_stats_record(enum isr_stats_id id, uint32_t cycles)
+{
+	struct isr_stats *s = &isr_stats[id];
+
+	s->count++;
+	s->last = cycles;
+	s->total += cycles;
+	if (cycles > s->max) {
+		s->max = cycles;
+	}
+	if (!s->min || (cycles < s->min)) {
+		s->min = cycles;
+	}
+}
+
+void isr_stats_reset(void);
+
+JSON_Value *isr_stats_json(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ISR_STATS_H_ */
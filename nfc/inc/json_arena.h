@@ -0,0 +1,43 @@
+#ifndef JSON_ARENA_H_
+#define JSON_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parson.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_ARENA_SIZE			(6 * 1024)	/* Static region */
+#define JSON_ARENA_CHUNK_SIZE	(1024)		/* Minimum fallback chunk taken from the heap */
+
+/**
+ * @struct 	json_arena_stats
+ * @brief	usage counters of the request arena.
+ */
+struct json_arena_stats {
+	uint32_t requests;			/* Requests served since boot */
+	uint32_t high_water;		/* Max bytes used by a single request */
+	uint32_t fallback_chunks;	/* Heap chunks taken since boot */
+	uint32_t heap_allocs;		/* Allocations made outside a request since boot */
+};
+
+void json_arena_init(void);
+
+void json_arena_begin(void);
+
+void json_arena_end(void);
+
+void *json_arena_malloc(size_t size);
+
+void json_arena_free(void *ptr);
+
+void json_arena_get_stats(struct json_arena_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSON_ARENA_H_ */
@@ -1,11 +1,24 @@
 #ifndef JSON_WP_H
 #define	JSON_WP_H
 
+#include "parson.h"
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
-int json_wp(char *rx_buffer, char **tx_buffer);
+/* Length of the hexadecimal length header preceding every response */
+#define JSON_WP_HEADER_LEN	4
+
+int json_wp(char *rx_buffer, char *buff, int size, char **tx_buffer);
+
+int json_wp_nonblocking(char *rx_buffer, char *buff, int size,
+		char **tx_buffer);
+
+int json_wp_serialize(JSON_Value const *value, char *buff, int size,
+		char **tx_buffer);
+
+void json_wp_release(char *buff, char *tx_buffer);
 
 #ifdef	__cplusplus
 }
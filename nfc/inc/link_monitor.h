@@ -0,0 +1,61 @@
+#ifndef LINK_MONITOR_H_
+#define LINK_MONITOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "lwip/netif.h"
+#include "parson.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* PHY status poll period. lpcPHYStsPoll() reads one PHY register per call,
+   so a link change is seen within a few periods */
+#define LINK_MONITOR_PERIOD_MS		50
+
+/* Polls skipped after a link change while the PHY settles */
+#define LINK_MONITOR_SETTLE_MS		250
+
+/* Link changes kept with their ticks */
+#define LINK_MONITOR_HISTORY		8
+
+/**
+ * @struct 	link_event
+ * @brief	a link change seen by the monitor.
+ */
+struct link_event {
+	TickType_t tick;
+	bool up;
+};
+
+/**
+ * @struct 	link_monitor_stats
+ * @brief	current link state and its changes since boot.
+ */
+struct link_monitor_stats {
+	bool up;
+	bool speed100;
+	bool full_duplex;
+	uint32_t ups;
+	uint32_t downs;				/* Flaps, the first link up is not one */
+	uint32_t polls;
+	TickType_t last_up_tick;
+	TickType_t last_down_tick;
+	uint32_t history_count;		/* Events in history, up to LINK_MONITOR_HISTORY */
+	struct link_event history[LINK_MONITOR_HISTORY];	/* Oldest first */
+};
+
+void link_monitor_init(struct netif *netif);
+
+void link_monitor_get_stats(struct link_monitor_stats *stats);
+
+JSON_Value *link_monitor_json(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LINK_MONITOR_H_ */
@@ -0,0 +1,22 @@
+#ifndef LOG_SERVER_H_
+#define LOG_SERVER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The log stream listens on the command port plus this offset */
+#define LOG_SERVER_PORT_OFFSET		1
+
+void log_server_init(uint16_t port);
+
+void log_server_restart(uint16_t port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_SERVER_H_ */
@@ -56,9 +56,22 @@ extern "C"
 /* Defines the number of descriptors used for RX */
 #define LPC_NUM_BUFF_RXDESCS 8
 
+/* Defines the number of zero-copy RX buffers. The ones above
+   LPC_NUM_BUFF_RXDESCS keep the ring full while lwIP holds received
+   frames */
+#define LPC_NUM_RX_PBUFS 12
+
+/* Maximum number of frames the receive task drains and passes to lwIP
+   in one batch before it lets the tcpip thread run */
+#define LPC_RX_BUDGET 8
+
 /* Defines the number of descriptors used for TX */
 #define LPC_NUM_BUFF_TXDESCS 8
 
+/* Maximum time a transmit waits for free TX descriptors before the
+   frame is dropped */
+#define LPC_TX_WAIT_MS 100
+
 /* Disable slow speed memory buffering */
 #define LPC_CHECK_SLOWMEM 1
 
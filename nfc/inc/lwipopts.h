@@ -44,10 +44,14 @@
 /* 32-bit alignment */
 #define MEM_ALIGNMENT                   4
 
-/* pbuf buffers in pool. In zero-copy mode, these buffers are
-   located in peripheral RAM. In copied mode, they are located in
-   internal IRAM */
-#define PBUF_POOL_SIZE                  17
+/* pbuf buffers in pool. The EMAC driver receives into its own buffers,
+   see LPC_NUM_RX_PBUFS, and nothing else allocates PBUF_POOL pbufs, so
+   the pool is left empty. The lwIP check of TCP_WND against this pool
+   would then fail, so its TCP checks are disabled and lwip_init.c checks
+   the window against the driver buffers instead, along with the other
+   TCP checks */
+#define PBUF_POOL_SIZE                  0
+#define LWIP_DISABLE_TCP_SANITY_CHECKS  1
 
 /* No padding needed */
 #define ETH_PAD_SIZE                    0
@@ -55,8 +59,25 @@
 #define IP_SOF_BROADCAST                1
 #define IP_SOF_BROADCAST_RECV           1
 
-/* The ethernet FCS is performed in hardware. The IP, TCP, and UDP
-   CRCs still need to be done in hardware. */
+/* The ethernet FCS is performed in hardware. With LPC_CHECKSUM_OFFLOAD
+   the ENET also inserts and verifies the IP, TCP, UDP and ICMP checksums,
+   and the EMAC driver checks in software the frames the MAC couldn't */
+#ifndef LPC_CHECKSUM_OFFLOAD
+#define LPC_CHECKSUM_OFFLOAD            1
+#endif
+
+#if LPC_CHECKSUM_OFFLOAD
+#define CHECKSUM_GEN_IP                 0
+#define CHECKSUM_GEN_UDP                0
+#define CHECKSUM_GEN_TCP                0
+/* Echo replies only patch the checksum, and the MAC doesn't insert it in
+   the fragments of a large reply */
+#define CHECKSUM_GEN_ICMP               1
+#define CHECKSUM_CHECK_IP               0
+#define CHECKSUM_CHECK_UDP              0
+#define CHECKSUM_CHECK_TCP              0
+#define LWIP_CHECKSUM_ON_COPY           0
+#else
 #define CHECKSUM_GEN_IP                 1
 #define CHECKSUM_GEN_UDP                1
 #define CHECKSUM_GEN_TCP                1
@@ -64,19 +85,31 @@
 #define CHECKSUM_CHECK_UDP              1
 #define CHECKSUM_CHECK_TCP              1
 #define LWIP_CHECKSUM_ON_COPY           1
+#endif
+
+/* Replaces the lwIP reference checksum with lpc_chksum(). Off until its
+   assembly path has been checked on the board, see tools/chksum_bench */
+#ifndef LPC_CHKSUM
+#define LPC_CHKSUM                      0
+#endif
 
 /* Use LWIP version of htonx() to allow generic functionality across
    all platforms. If you are using the Cortex Mx devices, you might
    be able to use the Cortex __rev instruction instead. */
 #define LWIP_PLATFORM_BYTESWAP          0
 
-/* Non-static memory, used with DMA pool */
+/* Non-static memory, used with DMA pool. Only TX pbufs come from here,
+   the EMAC driver receives into its own buffer ring */
 #ifdef __CODE_RED
-#define MEM_SIZE                        (12 * 1024)
+#define MEM_SIZE                        (8 * 1024)
 #else
 #define MEM_SIZE                        (24 * 1024)
 #endif
 
+/* The heap is placed in AHB SRAM by the EMAC driver */
+extern unsigned char lpc_ram_heap[];
+#define LWIP_RAM_HEAP_POINTER           lpc_ram_heap
+
 /* Raw interface not needed */
 #define LWIP_RAW                        0
 
@@ -95,12 +128,64 @@
 
 #define LWIP_SOCKET                     1
 #define LWIP_NETCONN                    1
-#define MEMP_NUM_SYS_TIMEOUT            300
+
+/* Static memp pools, counted from the connections and callbacks the
+   firmware creates, as noted on each pool. They were not derived from
+   measurements; NET_STATS reports the MAX and ERR of every pool to check
+   them on the board */
+
+/* Serve the command protocol with the raw API from the tcpip thread
+   instead of a socket task, see tcp_server_raw.c */
+#ifndef TCP_SERVER_RAW
+#define TCP_SERVER_RAW                  0
+#endif
+
+/* TCP, ARP and IP reassembly timers, plus margin for the API timeouts.
+   The raw command server adds its push timer */
+#define MEMP_NUM_SYS_TIMEOUT            (6 + TCP_SERVER_RAW)
+
+/* Command and log servers (listener + client each) and UDP telemetry */
+#define MEMP_NUM_NETCONN                6
+#define MEMP_NUM_TCP_PCB_LISTEN         2
+#define MEMP_NUM_UDP_PCB                2
+
+/* Both clients plus connections in TIME_WAIT after a reconnection */
+#define MEMP_NUM_TCP_PCB                5
+
+/* A full send queue for each client */
+#define MEMP_NUM_TCP_SEG                (2 * TCP_SND_QUEUELEN)
+
+#define MEMP_NUM_NETBUF                 4
+#define MEMP_NUM_PBUF                   8
+#define MEMP_NUM_REASSDATA              2
+#define MEMP_NUM_FRAG_PBUF              4
+#define MEMP_NUM_ARP_QUEUE              4
+
+/* netif->input is tcpip_input(), but the EMAC driver hands its frames
+   to the tcpip thread in batches with tcpip_callback_with_block(), see
+   lpc_rx_drain(). Nothing else takes from this pool */
+#define MEMP_NUM_TCPIP_MSG_INPKT        1
+
+/* Callbacks that can be pending at once: two RX batches (the next one is
+   posted while the previous one is input), a link change, a network
+   reconfiguration, the raw server start, and a getsockopt or setsockopt
+   from the command server, the log server and cmd_sched. Two spare */
+#define MEMP_NUM_TCPIP_MSG_API          10
 
 #define LWIP_SO_RCVTIMEO 				1
 
-#define LWIP_STATS                      0
-#define LINK_STATS                      0
+/* Only the counters reported by NET_STATS */
+#define LWIP_STATS                      1
+#define LINK_STATS                      1
+#define MEM_STATS                       1
+#define MEMP_STATS                      1
+#define ETHARP_STATS                    0
+#define IP_STATS                        0
+#define IPFRAG_STATS                    0
+#define ICMP_STATS                      0
+#define UDP_STATS                       0
+#define TCP_STATS                       0
+#define SYS_STATS                       0
 #define LWIP_STATS_DISPLAY              0
 
 /* There are more *_DEBUG options that can be selected.
@@ -128,12 +213,24 @@
 /* TCPIP thread must run at higher priority than MAC threads! */
 #define TCPIP_THREAD_PRIO               (configMAX_PRIORITIES)
 
+/* The raw command server parses and answers the requests in this thread */
+#if TCP_SERVER_RAW
+#define TCPIP_THREAD_STACKSIZE          (768)
+#else
 #define TCPIP_THREAD_STACKSIZE          (512)
+#endif
 
 #define TCPIP_MBOX_SIZE                 6
 
+/* lwIP semaphores signal their waiting task with a task notification
+   instead of being FreeRTOS queues, see sys_arch_freertos.c. Mailboxes
+   stay on queues either way */
+#ifndef SYS_ARCH_SEM_NOTIFY
+#define SYS_ARCH_SEM_NOTIFY             1
+#endif
+
 #define MEM_LIBC_MALLOC                 0
-#define MEMP_MEM_MALLOC                 1
+#define MEMP_MEM_MALLOC                 0
 
 /* Needed for malloc/free */
 #include "FreeRTOS.h"
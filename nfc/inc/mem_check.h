@@ -1,14 +1,27 @@
 #ifndef MEM_CHECK_H_
 #define MEM_CHECK_H_
 
+#include "parson.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define MEM_CHECK_SLICE_WORDS		256		/* Words read per scanner slice */
+#define MEM_CHECK_PASS_PERIOD_MS	5000	/* Time between the start of two passes */
+
+/* Set to 1 to run the scanner slices from the idle hook instead of a task at
+ * idle priority. Requires configUSE_IDLE_HOOK */
+#ifndef MEM_CHECK_IDLE_HOOK
+#define MEM_CHECK_IDLE_HOOK			0
+#endif
+
 void mem_check_init();
 
+JSON_Value *mem_check_json(void);
+
 #ifdef __cplusplus
 }
 #endif
 
-#endif /* MEM_CHEKC_H_ */
+#endif /* MEM_CHECK_H_ */
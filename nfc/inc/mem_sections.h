@@ -0,0 +1,27 @@
+#ifndef MEM_SECTIONS_H_
+#define MEM_SECTIONS_H_
+
+/*
+ * Placement of code and data in the RAM banks of the memory configuration.
+ * The managed linker script collects .ramfunc.$<bank>, .data.$<bank> and
+ * .bss.$<bank> into each bank, and the startup code copies and zeroes them
+ * through __data_section_table and __bss_section_table.
+ *
+ * RamLoc32 	local SRAM, CPU only: ISRs and the data they touch
+ * RamLoc40 	local SRAM, FreeRTOS heap
+ * RamAHB		AHB SRAM, shared with the Ethernet DMA: descriptors and pbufs
+ */
+
+/* Define RAMFUNC_DISABLE to run everything from flash, e.g. to compare the
+ * ISR cycle counts */
+#ifdef RAMFUNC_DISABLE
+#define RAMFUNC
+#else
+#define RAMFUNC				__attribute__((section (".ramfunc.$RamLoc32"), noinline))
+#endif
+
+#define BSS_RAMLOC32		__attribute__((section (".bss.$RamLoc32")))
+#define BSS_RAMLOC40		__attribute__((section (".bss.$RamLoc40")))
+#define BSS_RAMAHB			__attribute__((section (".bss.$RamAHB32_48_64")))
+
+#endif /* MEM_SECTIONS_H_ */
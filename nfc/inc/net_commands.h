@@ -4,14 +4,25 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "FreeRTOS.h"
 #include "parson.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+void net_commands_init(void);
+
 JSON_Value * cmd_execute(char const *cmd, JSON_Value const *pars);
 
+JSON_Value * cmd_execute_tick(char const *cmd, JSON_Value const *pars,
+		TickType_t *tick);
+
+bool cmd_try_execute(char const *cmd, JSON_Value const *pars,
+		JSON_Value **ans);
+
+bool cmd_may_block(char const *cmd);
+
 #ifdef __cplusplus
 }
 #endif
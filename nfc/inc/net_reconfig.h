@@ -0,0 +1,32 @@
+#ifndef NET_RECONFIG_H_
+#define NET_RECONFIG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "settings.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Lets the response to NETWORK_SETTINGS go out before the address changes */
+#define NET_RECONFIG_APPLY_DELAY_MS		100
+
+/* Retry period when the tcpip mailbox or cmd_sched are busy */
+#define NET_RECONFIG_RETRY_MS			10
+
+/* Longest time a client gets to reconnect */
+#define NET_RECONFIG_MAX_ROLLBACK_MS	600000
+
+void net_reconfig_init(uint16_t port);
+
+bool net_reconfig_start(struct settings settings, uint32_t rollback_ms);
+
+void net_reconfig_client_connected(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NET_RECONFIG_H_ */
@@ -0,0 +1,58 @@
+#ifndef RTOS_STATIC_H_
+#define RTOS_STATIC_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "timers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @enum 	rtos_bank
+ * @brief	RAM banks the static objects can be placed in. Names follow the
+ * 			memory configuration of the project.
+ */
+enum rtos_bank {
+	RTOS_BANK_RAMLOC32,		/* 0x10000000, default .data and .bss */
+	RTOS_BANK_RAMLOC40,		/* 0x10080000, shared with the FreeRTOS heap */
+	RTOS_BANK_RAMAHB,		/* 0x20000000, AHB RAM */
+	RTOS_BANKS,
+};
+
+/* Static pool of every bank, only used with configSUPPORT_STATIC_ALLOCATION */
+#define RTOS_RAMLOC32_POOL_SIZE		(1 * 1024)
+#define RTOS_RAMLOC40_POOL_SIZE		(20 * 1024)
+#define RTOS_RAMAHB_POOL_SIZE		(14 * 1024)
+
+/* Bank of the network threads created by sys_thread_new() */
+#define RTOS_LWIP_BANK				RTOS_BANK_RAMLOC40
+
+TaskHandle_t rtos_task_create(TaskFunction_t function, const char *name,
+		uint16_t stack_words, void *par, UBaseType_t priority,
+		enum rtos_bank bank);
+
+QueueHandle_t rtos_queue_create(UBaseType_t length, UBaseType_t item_size,
+		enum rtos_bank bank);
+
+SemaphoreHandle_t rtos_mutex_create(enum rtos_bank bank);
+
+SemaphoreHandle_t rtos_semaphore_create_counting(UBaseType_t max,
+		UBaseType_t initial, enum rtos_bank bank);
+
+TimerHandle_t rtos_timer_create(const char *name, TickType_t period,
+		UBaseType_t auto_reload, TimerCallbackFunction_t callback,
+		enum rtos_bank bank);
+
+void rtos_memory_map_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTOS_STATIC_H_ */
@@ -9,11 +9,16 @@
 extern "C" {
 #endif
 
+#define SETTINGS_TELEMETRY_MAX_RATE		1000
+
 struct settings {
 	ip_addr_t	gw;
 	ip_addr_t	ipaddr;
 	ip_addr_t	netmask;
 	uint16_t	port;
+	uint16_t	telemetry_port;		/* UDP telemetry destination port */
+	ip_addr_t	telemetry_addr;		/* UDP telemetry unicast or multicast destination */
+	uint16_t	telemetry_rate;		/* UDP telemetry datagrams per second, 0 disables it */
 };
 
 void settings_init();
@@ -4,12 +4,32 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "parson.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @struct 	tcp_server_stats
+ * @brief	latency of the command server, from the reception of a request
+ * 			until its response is handed to the stack.
+ */
+struct tcp_server_stats {
+	uint32_t requests;
+	uint32_t last_us;
+	uint32_t max_us;
+	uint64_t total_us;
+};
+
 void stackIp_ThreadInit(uint16_t port);
 
+void tcp_server_restart(uint16_t port);
+
+void tcp_server_latency_record(uint32_t cycles);
+
+JSON_Value *tcp_server_stats_json(void);
+
 #ifdef __cplusplus
 }
 #endif
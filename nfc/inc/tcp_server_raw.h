@@ -0,0 +1,22 @@
+#ifndef TCP_SERVER_RAW_H_
+#define TCP_SERVER_RAW_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Largest request accepted in a single segment */
+#define TCP_SERVER_RAW_RX_SIZE		1024
+
+void tcp_server_raw_init(uint16_t port);
+
+void tcp_server_raw_restart(uint16_t port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TCP_SERVER_RAW_H_ */
@@ -0,0 +1,59 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "parson.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_MIN_PERIOD_MS		10
+#define TELEMETRY_DEFAULT_PERIOD_MS	100
+
+enum telemetry_fields {
+	TELEMETRY_POSITIONS 	= (1 << 0),
+	TELEMETRY_ENCODERS 		= (1 << 1),
+	TELEMETRY_STALLED 		= (1 << 2),
+	TELEMETRY_TEMPERATURES 	= (1 << 3),
+	TELEMETRY_ALL			= (TELEMETRY_POSITIONS | TELEMETRY_ENCODERS
+								| TELEMETRY_STALLED | TELEMETRY_TEMPERATURES),
+};
+
+/**
+ * @struct 	telemetry_snapshot
+ * @brief	values sampled at a single tick for every telemetry field group.
+ */
+struct telemetry_snapshot {
+	uint32_t tick;
+	int32_t posAct[3];
+	int32_t posCmd[3];
+	int32_t count_a;
+	int32_t count_b;
+	int32_t count_z;
+	bool stalled[3];
+	float temperatures[2];
+};
+
+void telemetry_sample(struct telemetry_snapshot *snap);
+
+bool telemetry_subscribe(uint32_t fields, uint32_t period_ms, bool delta);
+
+void telemetry_unsubscribe(void);
+
+bool telemetry_subscribed(void);
+
+uint32_t telemetry_ms_to_next_push(void);
+
+JSON_Value* telemetry_push_json(void);
+
+uint32_t telemetry_fields_from_json(JSON_Array const *names);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_H_ */
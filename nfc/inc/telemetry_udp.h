@@ -0,0 +1,48 @@
+#ifndef TELEMETRY_UDP_H_
+#define TELEMETRY_UDP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lwip/ip_addr.h"
+#include "parson.h"
+#include "settings.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_UDP_MAGIC			0x4C455452	/* "RTEL" little endian */
+#define TELEMETRY_UDP_VERSION		1
+
+/**
+ * @struct 	telemetry_udp_datagram
+ * @brief	fixed layout of the UDP telemetry datagrams. All fields are little endian.
+ */
+struct __attribute__((packed)) telemetry_udp_datagram {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t size;				/* sizeof(struct telemetry_udp_datagram) */
+	uint32_t seq;
+	uint32_t tick;
+	int32_t posAct[3];
+	int32_t posCmd[3];
+	int32_t count_a;
+	int32_t count_b;
+	int32_t count_z;
+	uint8_t stalled[3];
+	uint8_t reserved;
+	float temperatures[2];
+};
+
+void telemetry_udp_init(struct settings settings);
+
+void telemetry_udp_config(ip_addr_t addr, uint16_t port, uint16_t rate);
+
+JSON_Value *telemetry_udp_json(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_UDP_H_ */
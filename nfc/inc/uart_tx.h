@@ -0,0 +1,38 @@
+#ifndef UART_TX_H_
+#define UART_TX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UART_TX_BUF_SIZE	2048	/* Must be a power of 2 */
+
+/* GPDMA peripheral connection, must match DEBUG_UART */
+#define UART_TX_DMA_CONN	GPDMA_CONN_UART2_Tx
+
+enum uart_tx_overflow {
+	UART_TX_DROP,		/* Drop what doesn't fit, counting the dropped bytes */
+	UART_TX_WAIT,		/* Wait for room when called from a task, drop otherwise */
+};
+
+void uart_tx_init(enum uart_tx_overflow overflow);
+
+void uart_tx_set_overflow(enum uart_tx_overflow overflow);
+
+size_t uart_tx_write(const char *buf, size_t len);
+
+bool uart_tx_flush(TickType_t timeout);
+
+uint32_t uart_tx_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UART_TX_H_ */
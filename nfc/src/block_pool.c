@@ -0,0 +1,168 @@
+#include "block_pool.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/**
+ * @struct 	block_pool_free_block
+ * @brief	a free block, linked through its first word.
+ */
+struct block_pool_free_block {
+	struct block_pool_free_block *next;
+};
+
+/**
+ * @struct 	block_pool_class
+ * @brief	a size class: a contiguous array of equal blocks and the stack of
+ * 			the free ones.
+ */
+struct block_pool_class {
+	uint8_t *start;
+	uint8_t *end;
+	struct block_pool_free_block *free;
+	struct block_pool_stats stats;
+};
+
+static const uint16_t block_sizes[BLOCK_POOL_CLASSES] = BLOCK_POOL_SIZES;
+
+static uint8_t __attribute__((aligned(portBYTE_ALIGNMENT))) pool_region[BLOCK_POOL_CLASSES
+		* BLOCK_POOL_CLASS_BYTES];
+
+static struct block_pool_class classes[BLOCK_POOL_CLASSES];
+
+static uint32_t heap_allocs;
+
+/**
+ * @brief 	carves the size classes out of the static region and links their
+ * 			free blocks. Must be called before any other function.
+ * @returns	nothing
+ */
+void block_pool_init(void)
+{
+	uint8_t *p = pool_region;
+
+	for (int i = 0; i < BLOCK_POOL_CLASSES; i++) {
+		struct block_pool_class *c = &classes[i];
+
+		configASSERT((block_sizes[i] % portBYTE_ALIGNMENT) == 0);
+
+		uint16_t count = BLOCK_POOL_CLASS_BYTES / block_sizes[i];
+
+		c->start = p;
+		c->free = NULL;
+		for (int b = count - 1; b >= 0; b--) {
+			struct block_pool_free_block *block =
+					(struct block_pool_free_block*) (p + b * block_sizes[i]);
+			block->next = c->free;
+			c->free = block;
+		}
+		p += BLOCK_POOL_CLASS_BYTES;
+		c->end = c->start + count * block_sizes[i];
+
+		c->stats.block_size = block_sizes[i];
+		c->stats.blocks = count;
+	}
+}
+
+/**
+ * @brief 	allocates a block from the smallest class that fits and has free
+ * 			blocks, falling back to the heap when there is none.
+ * @param 	size	: bytes to allocate
+ * @returns	pointer to the allocated memory, NULL if out of memory
+ * @note	can be called from ISRs as long as the heap fallback isn't needed.
+ */
+void* block_pool_malloc(size_t size)
+{
+	for (int i = 0; i < BLOCK_POOL_CLASSES; i++) {
+		struct block_pool_class *c = &classes[i];
+		if (size > c->stats.block_size) {
+			continue;
+		}
+
+		UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+		struct block_pool_free_block *block = c->free;
+		if (block) {
+			c->free = block->next;
+			c->stats.allocs++;
+			if (++c->stats.in_use > c->stats.high_water) {
+				c->stats.high_water = c->stats.in_use;
+			}
+		} else {
+			c->stats.overflows++;
+		}
+		portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+		if (block) {
+			return block;
+		}
+	}
+
+	heap_allocs++;
+	return pvPortMalloc(size);
+}
+
+/**
+ * @brief 	returns a block to its class, or to the heap if it came from there.
+ * @param 	ptr		: pointer returned by block_pool_malloc(), or NULL
+ * @returns	nothing
+ */
+void block_pool_free(void *ptr)
+{
+	if (!ptr) {
+		return;
+	}
+
+	for (int i = 0; i < BLOCK_POOL_CLASSES; i++) {
+		struct block_pool_class *c = &classes[i];
+		if (((uint8_t*) ptr < c->start) || ((uint8_t*) ptr >= c->end)) {
+			continue;
+		}
+
+		configASSERT((((uint8_t* ) ptr - c->start) % c->stats.block_size) == 0);
+
+		struct block_pool_free_block *block = ptr;
+		UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+		block->next = c->free;
+		c->free = block;
+		c->stats.in_use--;
+		portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+		return;
+	}
+
+	vPortFree(ptr);
+}
+
+/**
+ * @brief 	returns if the pointer belongs to one of the size classes.
+ */
+bool block_pool_owns(void const *ptr)
+{
+	return ((uint8_t const*) ptr >= pool_region)
+			&& ((uint8_t const*) ptr < pool_region + sizeof(pool_region));
+}
+
+/**
+ * @brief 	returns the usage counters of every size class.
+ * @param 	stats	: array of BLOCK_POOL_CLASSES structures to fill
+ * @returns	nothing
+ */
+void block_pool_get_stats(struct block_pool_stats stats[BLOCK_POOL_CLASSES])
+{
+	UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+	for (int i = 0; i < BLOCK_POOL_CLASSES; i++) {
+		stats[i] = classes[i].stats;
+	}
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+/**
+ * @brief 	returns the number of allocations that fell back to the heap,
+ * 			because they were too large or every fitting class was empty.
+ */
+uint32_t block_pool_heap_allocs(void)
+{
+	return heap_allocs;
+}
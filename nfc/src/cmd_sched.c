@@ -0,0 +1,361 @@
+#include "cmd_sched.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "debug.h"
+#include "net_commands.h"
+#include "block_pool.h"
+#include "rtos_static.h"
+
+#define CMD_SCHED_TASK_PRIORITY ( configMAX_PRIORITIES - 1 )
+
+enum cmd_sched_state {
+	CMD_SCHED_FREE,
+	CMD_SCHED_PENDING,
+	CMD_SCHED_RUNNING,
+	CMD_SCHED_DONE,
+};
+
+/**
+ * @struct 	cmd_sched_entry
+ * @brief	a command waiting for its execution tick, or its result waiting
+ * 			to be reported to the client.
+ */
+struct cmd_sched_entry {
+	enum cmd_sched_state state;
+	uint32_t id;
+	char name[CMD_SCHED_NAME_LEN];
+	char *pars;					/* Serialized parameters, NULL if none */
+	TickType_t at_tick;			/* Requested execution tick */
+	TickType_t tick;			/* Actual execution tick */
+	TickType_t done_tick;		/* Tick the result was ready at */
+	JSON_Value *ans;
+};
+
+static struct cmd_sched_entry entries[CMD_SCHED_MAX];
+
+static SemaphoreHandle_t cmd_sched_mutex;
+
+static TaskHandle_t cmd_sched_task_handle = NULL;
+
+static uint32_t cmd_sched_next_id;
+
+/**
+ * @struct 	cmd_sched_deferred
+ * @brief	function handed over by cmd_sched_defer(), fn is NULL if none.
+ */
+static struct cmd_sched_deferred {
+	void (*fn)(void *arg);
+	void *arg;
+} deferred;
+
+/**
+ * @brief 	returns the pending entry with the earliest execution tick.
+ * @returns	NULL if there are no pending entries
+ * @note	must be called with cmd_sched_mutex taken.
+ */
+static struct cmd_sched_entry* cmd_sched_earliest(void)
+{
+	struct cmd_sched_entry *earliest = NULL;
+
+	for (int i = 0; i < CMD_SCHED_MAX; i++) {
+		if ((entries[i].state == CMD_SCHED_PENDING)
+				&& (!earliest
+						|| ((int32_t) (entries[i].at_tick - earliest->at_tick)
+								< 0))) {
+			earliest = &entries[i];
+		}
+	}
+	return earliest;
+}
+
+/**
+ * @brief 	frees a DONE entry without reporting its result.
+ * @note	must be called with cmd_sched_mutex taken.
+ */
+static void cmd_sched_drop(struct cmd_sched_entry *entry)
+{
+	json_value_free(entry->ans);
+	entry->ans = NULL;
+	entry->state = CMD_SCHED_FREE;
+}
+
+/**
+ * @brief 	drops the results older than CMD_SCHED_RESULT_TTL_MS.
+ * @note	must be called with cmd_sched_mutex taken.
+ */
+static void cmd_sched_expire(void)
+{
+	TickType_t now = xTaskGetTickCount();
+
+	for (int i = 0; i < CMD_SCHED_MAX; i++) {
+		if ((entries[i].state == CMD_SCHED_DONE)
+				&& ((now - entries[i].done_tick)
+						>= pdMS_TO_TICKS(CMD_SCHED_RESULT_TTL_MS))) {
+			lDebug(Warn, "Scheduled command %lu: result not reported",
+					entries[i].id);
+			cmd_sched_drop(&entries[i]);
+		}
+	}
+}
+
+static void cmd_sched_task(void *par)
+{
+	while (true) {
+		TickType_t wait = portMAX_DELAY;
+
+		taskENTER_CRITICAL();
+		struct cmd_sched_deferred call = deferred;
+		deferred.fn = NULL;
+		taskEXIT_CRITICAL();
+		if (call.fn) {
+			call.fn(call.arg);
+		}
+
+		xSemaphoreTake(cmd_sched_mutex, portMAX_DELAY);
+		struct cmd_sched_entry *entry = cmd_sched_earliest();
+		if (entry) {
+			int32_t diff = (int32_t) (entry->at_tick - xTaskGetTickCount());
+			if (diff <= 0) {
+				entry->state = CMD_SCHED_RUNNING;
+				wait = 0;
+			} else {
+				entry = NULL;
+				wait = diff;
+			}
+		}
+		xSemaphoreGive(cmd_sched_mutex);
+
+		if (!entry) {
+			/* Woken up early by cmd_sched_add() if a new command comes first */
+			ulTaskNotifyTake(pdTRUE, wait);
+			continue;
+		}
+
+		/* The entry is ours while RUNNING, parse the parameters before
+		 * taking the execution tick so the parsing doesn't add jitter */
+		JSON_Value *pars = NULL;
+		if (entry->pars) {
+			pars = json_parse_string(entry->pars);
+			block_pool_free(entry->pars);
+			entry->pars = NULL;
+		}
+
+		/* The tick is taken once the command can run, a command in progress
+		 * elsewhere shows as jitter */
+		entry->ans = cmd_execute_tick(entry->name, pars, &entry->tick);
+		json_value_free(pars);
+
+		lDebug(Info, "Scheduled command %lu: %s, jitter: %ld ticks", entry->id,
+				entry->name, (int32_t ) (entry->tick - entry->at_tick));
+
+		xSemaphoreTake(cmd_sched_mutex, portMAX_DELAY);
+		entry->done_tick = xTaskGetTickCount();
+		entry->state = CMD_SCHED_DONE;
+		xSemaphoreGive(cmd_sched_mutex);
+	}
+}
+
+/**
+ * @brief 	creates the task that executes the scheduled commands.
+ * @returns	nothing
+ */
+void cmd_sched_init(void)
+{
+	cmd_sched_mutex = rtos_mutex_create(RTOS_BANK_RAMLOC32);
+
+	cmd_sched_task_handle = rtos_task_create(cmd_sched_task, "CmdSched",
+			configMINIMAL_STACK_SIZE * 4, NULL, CMD_SCHED_TASK_PRIORITY,
+			RTOS_BANK_RAMAHB);
+	lDebug(Info, "CmdSched: task created");
+}
+
+/**
+ * @brief 	schedules a command to be executed at the specified tick.
+ * @param 	*cmd 		:name of the command to execute
+ * @param   *pars   	:JSON object containing the parameters, copied
+ * @param   at_tick   	:xTaskGetTickCount() value at which to execute it
+ * @returns	JSON object with the ACK, the id used to report the result and
+ * 			the current tick. Caller must free it
+ */
+JSON_Value* cmd_sched_add(char const *cmd, JSON_Value const *pars,
+		TickType_t at_tick)
+{
+	JSON_Value *ans = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(ans);
+	TickType_t now = xTaskGetTickCount();
+	struct cmd_sched_entry *entry = NULL;
+	char *pars_str = NULL;
+
+	json_object_set_number(obj, "AT_TICK", at_tick);
+	json_object_set_number(obj, "TICK", now);
+
+	if (!cmd || (strlen(cmd) >= CMD_SCHED_NAME_LEN)
+			|| ((int32_t) (at_tick - now) < 0)) {
+		lDebug(Error, "Unable to schedule command");
+		json_object_set_boolean(obj, "ACK", false);
+		return ans;
+	}
+
+	/* The parameters must outlive the request, keep them out of the
+	 * request arena */
+	if (pars) {
+		size_t size = json_serialization_size(pars);
+		pars_str = block_pool_malloc(size);
+		if (!pars_str) {
+			lDebug(Error, "Out Of Memory");
+			json_object_set_boolean(obj, "ACK", false);
+			return ans;
+		}
+		json_serialize_to_buffer(pars, pars_str, size);
+	}
+
+	xSemaphoreTake(cmd_sched_mutex, portMAX_DELAY);
+	cmd_sched_expire();
+	for (int i = 0; i < CMD_SCHED_MAX; i++) {
+		if (entries[i].state == CMD_SCHED_FREE) {
+			entry = &entries[i];
+			entry->id = ++cmd_sched_next_id;
+			strcpy(entry->name, cmd);
+			entry->pars = pars_str;
+			entry->at_tick = at_tick;
+			entry->ans = NULL;
+			entry->state = CMD_SCHED_PENDING;
+			break;
+		}
+	}
+	xSemaphoreGive(cmd_sched_mutex);
+
+	if (!entry) {
+		lDebug(Error, "Command schedule full");
+		block_pool_free(pars_str);
+		json_object_set_boolean(obj, "ACK", false);
+		return ans;
+	}
+
+	xTaskNotifyGive(cmd_sched_task_handle);
+
+	json_object_set_boolean(obj, "ACK", true);
+	json_object_set_number(obj, "ID", entry->id);
+	return ans;
+}
+
+/**
+ * @brief 	hands a function to the cmd_sched task, for callers that must
+ * 			not block, such as timer callbacks.
+ * @param 	fn 		:function to call, before the commands that are due
+ * @param   arg   	:argument passed to fn
+ * @returns	false if the previous function wasn't called yet, retry later
+ * @note	doesn't block, not for ISRs.
+ */
+bool cmd_sched_defer(void (*fn)(void *arg), void *arg)
+{
+	taskENTER_CRITICAL();
+	bool empty = !deferred.fn;
+	if (empty) {
+		deferred.fn = fn;
+		deferred.arg = arg;
+	}
+	taskEXIT_CRITICAL();
+
+	if (empty) {
+		xTaskNotifyGive(cmd_sched_task_handle);
+	}
+	return empty;
+}
+
+/**
+ * @brief 	returns the time left until there's a result to report.
+ * @returns	0 if no command is pending
+ * @returns	the milliseconds to wait, at least 1
+ */
+uint32_t cmd_sched_ms_to_next_result(void)
+{
+	uint32_t ms = 0;
+
+	xSemaphoreTake(cmd_sched_mutex, portMAX_DELAY);
+	struct cmd_sched_entry *entry = cmd_sched_earliest();
+	if (entry) {
+		int32_t diff = (int32_t) (entry->at_tick - xTaskGetTickCount());
+		ms = (diff > 0) ? (diff * portTICK_PERIOD_MS) + 1 : 1;
+	}
+
+	for (int i = 0; i < CMD_SCHED_MAX; i++) {
+		if ((entries[i].state == CMD_SCHED_RUNNING)
+				|| (entries[i].state == CMD_SCHED_DONE)) {
+			ms = 1;
+		}
+	}
+	xSemaphoreGive(cmd_sched_mutex);
+	return ms;
+}
+
+/**
+ * @brief 	builds the report of the executed commands, releasing their entries.
+ * @returns	NULL if no command was executed since the last report
+ * @returns	JSON object with the answer, the execution tick and the jitter
+ * 			in ticks of every executed command. Caller must free it
+ */
+JSON_Value* cmd_sched_results_json(void)
+{
+	JSON_Value *results = NULL;
+
+	xSemaphoreTake(cmd_sched_mutex, portMAX_DELAY);
+	for (int i = 0; i < CMD_SCHED_MAX; i++) {
+		struct cmd_sched_entry *entry = &entries[i];
+		if (entry->state != CMD_SCHED_DONE) {
+			continue;
+		}
+
+		if (!results) {
+			results = json_value_init_array();
+		}
+
+		JSON_Value *result = json_value_init_object();
+		JSON_Object *obj = json_value_get_object(result);
+		json_object_set_number(obj, "ID", entry->id);
+		json_object_set_string(obj, "COMMAND", entry->name);
+		json_object_set_number(obj, "AT_TICK", entry->at_tick);
+		json_object_set_number(obj, "TICK", entry->tick);
+		json_object_set_number(obj, "JITTER",
+				(int32_t) (entry->tick - entry->at_tick));
+		if (entry->ans) {
+			json_object_set_value(obj, "ANS", entry->ans);
+			entry->ans = NULL;
+		}
+		json_array_append_value(json_value_get_array(results), result);
+
+		entry->state = CMD_SCHED_FREE;
+	}
+	xSemaphoreGive(cmd_sched_mutex);
+
+	if (!results) {
+		return NULL;
+	}
+
+	JSON_Value *ans = json_value_init_object();
+	json_object_set_value(json_value_get_object(ans), "SCHEDULED", results);
+	return ans;
+}
+
+/**
+ * @brief 	drops the results not reported yet, when the client that
+ * 			scheduled them disconnects.
+ * @returns	nothing
+ */
+void cmd_sched_results_drop(void)
+{
+	xSemaphoreTake(cmd_sched_mutex, portMAX_DELAY);
+	for (int i = 0; i < CMD_SCHED_MAX; i++) {
+		if (entries[i].state == CMD_SCHED_DONE) {
+			cmd_sched_drop(&entries[i]);
+		}
+	}
+	xSemaphoreGive(cmd_sched_mutex);
+}
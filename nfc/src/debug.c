@@ -1,28 +1,501 @@
 #include "debug.h"
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "FreeRTOS.h"
 #include "task.h"
-#include "queue.h"
 #include "semphr.h"
+#include "rtos_static.h"
 
 enum debugLevels debugLocalLevel = Info;
 enum debugLevels debugNetLevel = Info;
 
-QueueHandle_t debug_queue = NULL;
 bool debug_to_network = true;
 
 FILE *debugFile = NULL;
 
 SemaphoreHandle_t uart_mutex;
 
+#define DEBUG_TASK_PRIORITY 	( tskIDLE_PRIORITY + 1 )
+#define DEBUG_TASK_PERIOD_MS	10
+#define DEBUG_MSG_LEN			128
+#define DEBUG_SPEC_LEN			32	/* Flags, width, precision and length */
+#define DEBUG_SPEC_INT_LEN		12	/* Room for a '*' value and the '\0' */
+
+#define DEBUG_STR_TRUNCATED		'~'	/* Last character of a truncated %s */
+#define DEBUG_STR_DROPPED		DEBUG_RECORD_STR_LEN	/* %s with no room left */
+
+/**
+ * @struct 	debug_record
+ * @brief	a message captured by lDebug(), waiting to be formatted.
+ * @note	file, func and fmt are string literals, only their pointers are kept.
+ */
+struct debug_record {
+	uint32_t seq;				/* Ring position + 1, written last to commit */
+	uint32_t tick;
+	const struct debugModule *module;
+	const char *file;
+	const char *func;
+	const char *fmt;
+	uint16_t line;
+	uint8_t level;
+	uint8_t nargs;				/* Words used in args */
+	uint32_t args[DEBUG_RECORD_MAX_ARGS];
+	char str[DEBUG_RECORD_STR_LEN];
+};
+
+/**
+ * @struct 	debug_ring
+ * @brief	multiple producer, single consumer ring of captured messages.
+ * 			Producers reserve a slot moving head with a compare and swap and
+ * 			commit it writing its seq. The formatter task moves tail.
+ */
+struct debug_ring {
+	uint32_t head;
+	uint32_t tail;
+	uint32_t dropped;
+	struct debug_record records[DEBUG_RING_LEN];
+};
+
+static struct debug_ring ring;
+
+#define DEBUG_NET_SEQ_INVALID	UINT32_MAX
+
+/**
+ * @struct 	debug_net_line
+ * @brief	a formatted line waiting to be read by the network clients.
+ */
+struct debug_net_line {
+	uint32_t seq;
+	char text[DEBUG_NET_LINE_LEN];
+};
+
+/**
+ * @struct 	debug_net_ring
+ * @brief	last formatted lines for the network, overwritten oldest first.
+ * 			Written only by the Debug task. Every reader keeps its own
+ * 			sequence number, so a gap in the numbers means lost lines.
+ */
+struct debug_net_ring {
+	uint32_t head;				/* Sequence number of the next line */
+	TaskHandle_t listener;		/* Notified on every new line */
+	struct debug_net_line lines[DEBUG_NET_RING_LEN];
+};
+
+static struct debug_net_ring net_ring;
+
+/**
+ * @brief 	walks a printf conversion specification.
+ * @param 	**p		:pointer to the character following the '%', left
+ * 					 pointing at the conversion character
+ * @param 	*stars	:set to the number of '*' width or precision arguments
+ * @param 	*longs	:set to the number of 'l' length modifiers, 2 for 64 bit
+ * @returns	the conversion character, 0 at the end of the string
+ */
+static char debug_parse_spec(const char **p, int *stars, int *longs)
+{
+	const char *c = *p;
+
+	*stars = 0;
+	*longs = 0;
+
+	while (*c && strchr("-+ #0", *c)) {
+		c++;
+	}
+	for (int i = 0; i < 2; i++) {
+		if (*c == '*') {
+			(*stars)++;
+			c++;
+		}
+		while (*c >= '0' && *c <= '9') {
+			c++;
+		}
+		if (*c != '.') {
+			break;
+		}
+		c++;
+	}
+	while (*c && strchr("hlLjzt", *c)) {
+		if ((*c == 'l') || (*c == 'j')) {
+			(*longs) += (*c == 'j') ? 2 : 1;
+		}
+		c++;
+	}
+
+	*p = c;
+	return *c;
+}
+
+/**
+ * @brief 	returns the number of 32 bit words a conversion takes in a record.
+ */
+static int debug_spec_words(char conv, int stars, int longs)
+{
+	if (strchr("eEfFgGaA", conv) || (strchr("diouxX", conv) && longs >= 2)) {
+		return stars + 2;
+	}
+	return stars + (conv != 'n');
+}
+
+/**
+ * @brief 	stores the variable arguments of a message in its record, as raw
+ * 			32 bit words. Strings are copied, they may not outlive the caller.
+ * @param 	*rec 	:record to fill
+ * @param 	*fmt 	:format string of the message
+ * @param 	ap 		:arguments of the message
+ */
+static void debug_capture_args(struct debug_record *rec, const char *fmt,
+		va_list ap)
+{
+	int words = 0;
+	int str_used = 0;
+	int stars, longs;
+
+	for (const char *p = fmt; *p; p++) {
+		if ((*p != '%') || (*(++p) == '%')) {
+			continue;
+		}
+
+		char conv = debug_parse_spec(&p, &stars, &longs);
+		if (!conv) {
+			break;
+		}
+
+		if (words + debug_spec_words(conv, stars, longs)
+				> DEBUG_RECORD_MAX_ARGS) {
+			break;
+		}
+
+		while (stars--) {
+			rec->args[words++] = va_arg(ap, int);
+		}
+
+		if (strchr("eEfFgGaA", conv)) {
+			double d = va_arg(ap, double);
+			memcpy(&rec->args[words], &d, sizeof(d));
+			words += 2;
+		} else if (strchr("diouxX", conv) && longs >= 2) {
+			long long ll = va_arg(ap, long long);
+			memcpy(&rec->args[words], &ll, sizeof(ll));
+			words += 2;
+		} else if (conv == 's') {
+			const char *str = va_arg(ap, const char*);
+			int room = DEBUG_RECORD_STR_LEN - str_used - 1;
+			if (room < 1) {
+				rec->args[words++] = DEBUG_STR_DROPPED;
+				continue;
+			}
+
+			int len = str ? strnlen(str, room + 1) : 0;
+			bool truncated = len > room;
+			if (truncated) {
+				len = room;
+			}
+			memcpy(&rec->str[str_used], str, len);
+			if (truncated) {
+				rec->str[str_used + len - 1] = DEBUG_STR_TRUNCATED;
+			}
+			rec->str[str_used + len] = '\0';
+			rec->args[words++] = str_used;
+			str_used += len + 1;
+		} else if (conv == 'p') {
+			rec->args[words++] = (uint32_t) (uintptr_t) va_arg(ap, void*);
+		} else if (conv == 'n') {
+			(void) va_arg(ap, int*);
+		} else if (longs == 1) {
+			rec->args[words++] = va_arg(ap, unsigned long);
+		} else {
+			rec->args[words++] = va_arg(ap, unsigned int);
+		}
+	}
+	rec->nargs = words;
+}
+
+/**
+ * @brief 	captures a message in the ring. Called by lDebug(), use that instead.
+ * @note	doesn't block, allocate or format, can be called from ISRs. If the
+ * 			ring is full the message is dropped and counted.
+ */
+void debugLog(const struct debugModule *module, enum debugLevels level,
+		const char *file, int line, const char *func, const char *fmt, ...)
+{
+	uint32_t head = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+
+	do {
+		if ((head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE))
+				>= DEBUG_RING_LEN) {
+			__atomic_fetch_add(&ring.dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&ring.head, &head, head + 1, true,
+			__ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	struct debug_record *rec = &ring.records[head & (DEBUG_RING_LEN - 1)];
+
+	rec->tick =
+			xPortIsInsideInterrupt() ?
+					xTaskGetTickCountFromISR() : xTaskGetTickCount();
+	rec->module = module;
+	rec->file = file;
+	rec->func = func;
+	rec->fmt = fmt;
+	rec->line = line;
+	rec->level = level;
+
+	va_list ap;
+	va_start(ap, fmt);
+	debug_capture_args(rec, fmt, ap);
+	va_end(ap);
+
+	__atomic_store_n(&rec->seq, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 	formats a captured message, replaying its format string one
+ * 			conversion at a time with the stored arguments.
+ * @param 	*rec 	:record to format
+ * @param 	*out 	:output buffer
+ * @param 	size 	:size of the output buffer
+ */
+static void debug_format(const struct debug_record *rec, char *out, int size)
+{
+	int words = 0;
+	int len = 0;
+	int stars, longs;
+
+	for (const char *p = rec->fmt; *p && (len < size - 1); p++) {
+		if ((*p != '%') || (*(p + 1) == '%')) {
+			out[len++] = *p;
+			p += (*p == '%');
+			continue;
+		}
+
+		const char *start = p++;
+		char conv = debug_parse_spec(&p, &stars, &longs);
+		if (!conv) {
+			break;
+		}
+
+		/* Arguments that didn't fit in the record */
+		if (words + debug_spec_words(conv, stars, longs) > rec->nargs) {
+			words = rec->nargs;
+			len += snprintf(out + len, size - len, "?");
+			continue;
+		}
+
+		/* Rebuild the specification replacing the '*' with their values */
+		int next_words = words + debug_spec_words(conv, stars, longs);
+		char spec[DEBUG_SPEC_LEN];
+		int spec_len = 0;
+		const char *s;
+		for (s = start; (s <= p) && (spec_len < DEBUG_SPEC_LEN - DEBUG_SPEC_INT_LEN);
+				s++) {
+			if (*s == '*') {
+				spec_len += sprintf(spec + spec_len, "%d",
+						(int) rec->args[words++]);
+			} else {
+				spec[spec_len++] = *s;
+			}
+		}
+		spec[spec_len] = '\0';
+
+		/* Not a valid specification, skip its arguments */
+		if (s <= p) {
+			words = next_words;
+			len += snprintf(out + len, size - len, "?");
+			continue;
+		}
+
+		int n;
+		if (strchr("eEfFgGaA", conv)) {
+			double d;
+			memcpy(&d, &rec->args[words], sizeof(d));
+			words += 2;
+			n = snprintf(out + len, size - len, spec, d);
+		} else if (strchr("diouxX", conv) && longs >= 2) {
+			long long ll;
+			memcpy(&ll, &rec->args[words], sizeof(ll));
+			words += 2;
+			n = snprintf(out + len, size - len, spec, ll);
+		} else if (conv == 's') {
+			uint32_t str = rec->args[words++];
+			n = snprintf(out + len, size - len, spec,
+					(str == DEBUG_STR_DROPPED) ? "~" : &rec->str[str]);
+		} else if (conv == 'p') {
+			n = snprintf(out + len, size - len, spec,
+					(void*) (uintptr_t) rec->args[words++]);
+		} else if (conv == 'n') {
+			n = 0;
+		} else if (strchr("di", conv)) {
+			int32_t i = rec->args[words++];
+			n = (longs == 1) ?
+					snprintf(out + len, size - len, spec, (long) i) :
+					snprintf(out + len, size - len, spec, (int) i);
+		} else if (longs == 1) {
+			n = snprintf(out + len, size - len, spec,
+					(unsigned long) rec->args[words++]);
+		} else {
+			n = snprintf(out + len, size - len, spec,
+					(unsigned int) rec->args[words++]);
+		}
+
+		if (n > 0) {
+			len += n;
+		}
+	}
+
+	if (len > size - 1) {
+		len = size - 1;
+	}
+	out[len] = '\0';
+}
+
+/**
+ * @brief 	prints a formatted message to the UART and/or queues it for the
+ * 			network, according to the levels in effect.
+ */
+static void debug_output(const struct debug_record *rec, const char *msg)
+{
+	enum debugLevels level = rec->level;
+	const struct debugModule *module = rec->module;
+	int local_level = debugLocalLevel;
+	int net_level = debugNetLevel;
+
+	if (module && (module->level != DEBUG_MODULE_DEFAULT)) {
+		local_level = module->level;
+		net_level = module->level;
+	}
+
+	if (local_level <= (int) level) {
+		if (xSemaphoreTake(uart_mutex, portMAX_DELAY) == pdTRUE) {
+			printf("%lu - %s %s[%d] %s() %s\n", rec->tick, levelText(level),
+					rec->file, rec->line, rec->func, msg);
+			xSemaphoreGive(uart_mutex);
+		}
+	}
+
+	if (debug_to_network && (net_level <= (int) level) && (level != InfoLocal)) {
+		struct debug_net_line *slot = &net_ring.lines[net_ring.head
+				& (DEBUG_NET_RING_LEN - 1)];
+
+		/* Invalidate the slot while it's rewritten, see debugNetRead() */
+		__atomic_store_n(&slot->seq, DEBUG_NET_SEQ_INVALID, __ATOMIC_RELEASE);
+		snprintf(slot->text, sizeof(slot->text), "%lu - %s %s[%d] %s() %s",
+				rec->tick, levelText(level), rec->file, rec->line, rec->func,
+				msg);
+		__atomic_store_n(&slot->seq, net_ring.head, __ATOMIC_RELEASE);
+		__atomic_store_n(&net_ring.head, net_ring.head + 1, __ATOMIC_RELEASE);
+
+		if (net_ring.listener) {
+			xTaskNotifyGive(net_ring.listener);
+		}
+	}
+}
+
+static void debug_task(void *par)
+{
+	static char msg[DEBUG_MSG_LEN];
+	struct debug_record rec;
+	uint32_t dropped_reported = 0;
+
+	while (true) {
+		uint32_t tail = ring.tail;
+
+		while (tail != __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE)) {
+			struct debug_record *slot = &ring.records[tail
+					& (DEBUG_RING_LEN - 1)];
+
+			/* Reserved but not committed yet, the producer was preempted */
+			if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+				break;
+			}
+
+			rec = *slot;
+			__atomic_store_n(&ring.tail, ++tail, __ATOMIC_RELEASE);
+
+			debug_format(&rec, msg, sizeof(msg));
+			debug_output(&rec, msg);
+		}
+
+		uint32_t dropped = __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED);
+		if (dropped != dropped_reported) {
+			if (xSemaphoreTake(uart_mutex, portMAX_DELAY) == pdTRUE) {
+				printf("%lu - Warn %lu debug messages dropped\n",
+						xTaskGetTickCount(), dropped - dropped_reported);
+				xSemaphoreGive(uart_mutex);
+			}
+			dropped_reported = dropped;
+		}
+
+		vTaskDelay(pdMS_TO_TICKS(DEBUG_TASK_PERIOD_MS));
+	}
+}
+
 void debugInit(void)
 {
-	uart_mutex = xSemaphoreCreateMutex();
-	debug_queue = xQueueCreate(10, sizeof(char *));
+	uart_mutex = rtos_mutex_create(RTOS_BANK_RAMLOC32);
+
+	for (int i = 0; i < DEBUG_NET_RING_LEN; i++) {
+		net_ring.lines[i].seq = DEBUG_NET_SEQ_INVALID;
+	}
+
+	rtos_task_create(debug_task, "Debug", configMINIMAL_STACK_SIZE * 4, NULL,
+	DEBUG_TASK_PRIORITY, RTOS_BANK_RAMAHB);
+}
+
+/**
+ * @brief 	returns the number of messages dropped because the ring was full.
+ */
+uint32_t debugDropped(void)
+{
+	return __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED);
+}
+
+static struct debugModule *debug_modules = NULL;
+
+/**
+ * @brief 	adds a module to the list of modules with runtime level. Called
+ * 			through debugModuleThisRegister() from the init of the modules
+ * 			that define LOG_MODULE_NAME, adding it again does nothing.
+ * @param 	*module	:module to add
+ * @note	call before the scheduler is started.
+ */
+void debugModuleRegister(struct debugModule *module)
+{
+	for (struct debugModule *m = debug_modules; m; m = m->next) {
+		if (m == module) {
+			return;
+		}
+	}
+	module->next = debug_modules;
+	debug_modules = module;
+}
 
+/**
+ * @brief 	looks up a module by name, to change its runtime level.
+ * @param 	*name	:LOG_MODULE_NAME of the module
+ * @returns	NULL if there's no such module
+ */
+struct debugModule* debugModuleFind(const char *name)
+{
+	for (struct debugModule *m = debug_modules; m; m = m->next) {
+		if (!strcmp(m->name, name)) {
+			return m;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief 	returns the first registered module, follow next for the rest.
+ */
+struct debugModule* debugModuleFirst(void)
+{
+	return debug_modules;
 }
 
 /**
@@ -65,3 +538,50 @@ void debugClose(void)
 		debugFile = stderr;
 	}
 }
+
+/**
+ * @brief 	reads a line of the network log.
+ * @param 	*seq	:in, sequence number of the wanted line. Out, sequence
+ * 					 number of the line read, greater if older lines were lost
+ * @param 	*line	:buffer for the line
+ * @param 	size	:size of the buffer
+ * @returns	false if there is no line with that sequence number or a later one
+ */
+bool debugNetRead(uint32_t *seq, char *line, size_t size)
+{
+	while (true) {
+		uint32_t head = __atomic_load_n(&net_ring.head, __ATOMIC_ACQUIRE);
+
+		if ((int32_t) (head - *seq) <= 0) {
+			return false;
+		}
+		if ((head - *seq) > DEBUG_NET_RING_LEN) {
+			*seq = head - DEBUG_NET_RING_LEN;
+		}
+
+		struct debug_net_line *slot = &net_ring.lines[*seq
+				& (DEBUG_NET_RING_LEN - 1)];
+
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == *seq) {
+			strncpy(line, slot->text, size - 1);
+			line[size - 1] = '\0';
+
+			/* Still the same line after copying it? */
+			if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == *seq) {
+				return true;
+			}
+		}
+
+		/* Overwritten while reading, it's lost */
+		(*seq)++;
+	}
+}
+
+/**
+ * @brief 	sets the task to notify every time a line is added to the network log.
+ * @param 	task	:task handle, NULL to stop notifying
+ */
+void debugNetSetListener(TaskHandle_t task)
+{
+	net_ring.listener = task;
+}
@@ -9,32 +9,40 @@
 #include "board.h"
 #include "encoders.h"
 #include "gpio.h"
+#include "mem_sections.h"
+#include "isr_stats.h"
 
-int count_z = 0;
-int count_b = 0;
-int count_a = 0;
+int BSS_RAMLOC32 count_z = 0;
+int BSS_RAMLOC32 count_b = 0;
+int BSS_RAMLOC32 count_a = 0;
 
 
 /**
 * @brief	Handle interrupt from GPIO pin or GPIO pin mapped to PININT
 * @return	Nothing
 */
-void GPIO0_IRQHandler(void)
+void RAMFUNC GPIO0_IRQHandler(void)
 {
+	ISR_STATS_ENTER();
 	Chip_PININT_ClearIntStatus(LPC_GPIO_PIN_INT, PININTCH(0));
 	++count_z;
+	ISR_STATS_EXIT(ISR_STATS_GPIO0);
 }
 
-void GPIO1_IRQHandler(void)
+void RAMFUNC GPIO1_IRQHandler(void)
 {
+	ISR_STATS_ENTER();
 	Chip_PININT_ClearIntStatus(LPC_GPIO_PIN_INT, PININTCH(1));
 	++count_b;
+	ISR_STATS_EXIT(ISR_STATS_GPIO1);
 }
 
-void GPIO2_IRQHandler(void)
+void RAMFUNC GPIO2_IRQHandler(void)
 {
+	ISR_STATS_ENTER();
 	Chip_PININT_ClearIntStatus(LPC_GPIO_PIN_INT, PININTCH(2));
 	++count_a;
+	ISR_STATS_EXIT(ISR_STATS_GPIO2);
 }
 
 /**
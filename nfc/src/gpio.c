@@ -3,6 +3,7 @@
 
 #include "board.h"
 #include "mot_pap.h"
+#include "mem_sections.h"
 
 //struct gpio_entry pole_dir = { 4, 10, SCU_MODE_FUNC4, 5, 14 };		//DOUT6 P4_10 	PIN35	GPIO5[14] 	POLE_DIR
 //struct gpio_entry pole_step = { 1, 5, SCU_MODE_FUNC0, 1, 8 };		//DOUT7 P1_5 	PIN48 	GPIO1[8]   	POLE_PULSE
@@ -38,6 +39,6 @@ void gpio_set_pin_state(struct gpio_entry gpio, bool state) {
  * @brief	toggles GPIO corresponding pin passed as parameter
  * @returns nothing
  */
-void gpio_toggle(struct gpio_entry gpio) {
+void RAMFUNC gpio_toggle(struct gpio_entry gpio) {
 	Chip_GPIO_SetPinToggle(LPC_GPIO_PORT, gpio.gpio_port, gpio.gpio_bit);
 }
@@ -0,0 +1,74 @@
+#include "isr_stats.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "mem_sections.h"
+
+struct isr_stats BSS_RAMLOC32 isr_stats[ISR_STATS_COUNT];
+
+static const char *const isr_stats_names[ISR_STATS_COUNT] = {
+		[ISR_STATS_TIMER1] = "TIMER1",
+		[ISR_STATS_TIMER2] = "TIMER2",
+		[ISR_STATS_TIMER3] = "TIMER3",
+		[ISR_STATS_GPIO0] = "GPIO0",
+		[ISR_STATS_GPIO1] = "GPIO1",
+		[ISR_STATS_GPIO2] = "GPIO2",
+};
+
+/**
+ * @brief 	clears the counters of every ISR.
+ * @returns	nothing
+ */
+void isr_stats_reset(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	memset(isr_stats, 0, sizeof(isr_stats));
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief 	returns the cycle counts of every ISR that ran at least once.
+ * @returns	JSON object, caller must free it
+ */
+JSON_Value* isr_stats_json(void)
+{
+	struct isr_stats copy[ISR_STATS_COUNT];
+
+	/* The encoder interrupts run above configMAX_SYSCALL_INTERRUPT_PRIORITY */
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	memcpy(copy, isr_stats, sizeof(copy));
+	__set_PRIMASK(primask);
+
+	JSON_Value *ans = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(ans);
+
+#ifdef RAMFUNC_DISABLE
+	json_object_set_string(obj, "CODE", "FLASH");
+#else
+	json_object_set_string(obj, "CODE", "RAM");
+#endif
+	json_object_set_number(obj, "CPU_HZ", SystemCoreClock);
+
+	for (int i = 0; i < ISR_STATS_COUNT; i++) {
+		if (!copy[i].count) {
+			continue;
+		}
+
+		JSON_Value *isr = json_value_init_object();
+		JSON_Object *isr_obj = json_value_get_object(isr);
+		json_object_set_number(isr_obj, "COUNT", copy[i].count);
+		json_object_set_number(isr_obj, "LAST", copy[i].last);
+		json_object_set_number(isr_obj, "MIN", copy[i].min);
+		json_object_set_number(isr_obj, "MAX", copy[i].max);
+		json_object_set_number(isr_obj, "AVG",
+				(double) copy[i].total / copy[i].count);
+		json_object_set_value(obj, isr_stats_names[i], isr);
+	}
+	return ans;
+}
@@ -0,0 +1,217 @@
+#include "json_arena.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "debug.h"
+#include "block_pool.h"
+
+#define JSON_ARENA_ALIGN(x)	(((x) + (portBYTE_ALIGNMENT - 1)) & ~(portBYTE_ALIGNMENT - 1))
+
+/**
+ * @struct 	json_arena_chunk
+ * @brief	header of a fallback chunk taken from the heap when the static
+ * 			region is exhausted. The chunk data follows the header.
+ */
+struct json_arena_chunk {
+	struct json_arena_chunk *next;
+	size_t size;
+	size_t used;
+};
+
+/**
+ * @struct 	json_arena
+ * @brief	state of the request arena.
+ */
+struct json_arena {
+	TaskHandle_t owner;			/* Task serving the request, NULL if idle */
+	size_t used;				/* Bytes used in the static region */
+	size_t chunk_bytes;			/* Bytes used in fallback chunks */
+	size_t peak;				/* Max bytes used during this request */
+	void *last;					/* Last allocation, can be given back */
+	struct json_arena_chunk *chunks;
+	struct json_arena_stats stats;
+};
+
+static uint8_t __attribute__((aligned(portBYTE_ALIGNMENT))) arena_region[JSON_ARENA_SIZE];
+
+static struct json_arena arena;
+
+#define JSON_ARENA_CHUNK_HDR	JSON_ARENA_ALIGN(sizeof(struct json_arena_chunk))
+
+static inline uint8_t* chunk_data(struct json_arena_chunk *chunk)
+{
+	return (uint8_t*) chunk + JSON_ARENA_CHUNK_HDR;
+}
+
+static bool in_region(void *ptr)
+{
+	return ((uint8_t*) ptr >= arena_region)
+			&& ((uint8_t*) ptr < arena_region + JSON_ARENA_SIZE);
+}
+
+static struct json_arena_chunk* owning_chunk(void *ptr)
+{
+	for (struct json_arena_chunk *c = arena.chunks; c; c = c->next) {
+		if (((uint8_t*) ptr >= chunk_data(c))
+				&& ((uint8_t*) ptr < chunk_data(c) + c->size)) {
+			return c;
+		}
+	}
+	return NULL;
+}
+
+static inline void update_peak(void)
+{
+	if (arena.used + arena.chunk_bytes > arena.peak) {
+		arena.peak = arena.used + arena.chunk_bytes;
+	}
+}
+
+/**
+ * @brief 	returns if the calling task is serving the current request.
+ */
+static bool arena_owned(void)
+{
+	return arena.owner && (arena.owner == xTaskGetCurrentTaskHandle());
+}
+
+/**
+ * @brief 	installs the arena as the parson allocator.
+ * @returns	nothing
+ */
+void json_arena_init(void)
+{
+	json_set_allocation_functions(json_arena_malloc, json_arena_free);
+}
+
+/**
+ * @brief 	starts a request. Until json_arena_end() every parson allocation
+ * 			made by the calling task is served from the arena. Allocations
+ * 			made by other tasks go to the block pools.
+ * @returns	nothing
+ */
+void json_arena_begin(void)
+{
+	arena.used = 0;
+	arena.chunk_bytes = 0;
+	arena.peak = 0;
+	arena.last = NULL;
+	arena.owner = xTaskGetCurrentTaskHandle();
+}
+
+/**
+ * @brief 	ends the request, releasing everything allocated since
+ * 			json_arena_begin() at once.
+ * @returns	nothing
+ * @note	every JSON value built during the request must have been freed,
+ * 			or be no longer referenced, when this is called.
+ */
+void json_arena_end(void)
+{
+	arena.owner = NULL;
+
+	while (arena.chunks) {
+		struct json_arena_chunk *next = arena.chunks->next;
+		vPortFree(arena.chunks);
+		arena.chunks = next;
+	}
+
+	arena.used = 0;
+	arena.chunk_bytes = 0;
+	arena.last = NULL;
+
+	if (arena.peak) {
+		arena.stats.requests++;
+	}
+	if (arena.peak > arena.stats.high_water) {
+		arena.stats.high_water = arena.peak;
+	}
+}
+
+/**
+ * @brief 	parson allocation function.
+ * @param 	size	: bytes to allocate
+ * @returns	pointer to the allocated memory, NULL if out of memory
+ */
+void* json_arena_malloc(size_t size)
+{
+	if (!arena_owned()) {
+		arena.stats.heap_allocs++;
+		return block_pool_malloc(size);
+	}
+
+	size = JSON_ARENA_ALIGN(size);
+
+	if (arena.used + size <= JSON_ARENA_SIZE) {
+		arena.last = &arena_region[arena.used];
+		arena.used += size;
+		update_peak();
+		return arena.last;
+	}
+
+	struct json_arena_chunk *c = arena.chunks;
+	if (!c || (c->used + size > c->size)) {
+		size_t chunk_size =
+				(size > JSON_ARENA_CHUNK_SIZE) ? size : JSON_ARENA_CHUNK_SIZE;
+
+		c = pvPortMalloc(JSON_ARENA_CHUNK_HDR + chunk_size);
+		if (!c) {
+			lDebug(Error, "JSON arena: Out Of Memory");
+			return NULL;
+		}
+		c->size = chunk_size;
+		c->used = 0;
+		c->next = arena.chunks;
+		arena.chunks = c;
+		arena.stats.fallback_chunks++;
+	}
+
+	arena.last = chunk_data(c) + c->used;
+	c->used += size;
+	arena.chunk_bytes += size;
+	update_peak();
+	return arena.last;
+}
+
+/**
+ * @brief 	parson free function. Memory inside the arena is only reclaimed
+ * 			when it is the last allocation, which covers the temporary buffers
+ * 			parson frees right after using them. Anything else is released by
+ * 			json_arena_end().
+ * @param 	ptr		: pointer to release
+ * @returns	nothing
+ */
+void json_arena_free(void *ptr)
+{
+	if (!ptr) {
+		return;
+	}
+
+	if (in_region(ptr)) {
+		if (ptr == arena.last) {
+			arena.used = (uint8_t*) ptr - arena_region;
+			arena.last = NULL;
+		}
+		return;
+	}
+
+	if (owning_chunk(ptr)) {
+		return;
+	}
+
+	block_pool_free(ptr);
+}
+
+/**
+ * @brief 	returns the arena usage counters.
+ * @param 	stats	: pointer to the structure to fill
+ * @returns	nothing
+ */
+void json_arena_get_stats(struct json_arena_stats *stats)
+{
+	*stats = arena.stats;
+}
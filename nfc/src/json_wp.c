@@ -1,10 +1,17 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "task.h"
 #include "debug.h"
+#include "json_arena.h"
+#include "block_pool.h"
 
 #include "parson.h"
 #include "json_wp.h"
 #include "net_commands.h"
+#include "cmd_sched.h"
 
 /**
  * @brief Defines a simple wire protocol base on JavaScript Object Notation (JSON)
@@ -36,17 +43,91 @@
  * Every executed command has the chance of returning a JSON object that will be inserted
  * in the response JSON object under a key corresponding to the executed command name, or
  * NULL if no answer is expected.
+ *
+ * A command entry can carry an "at_tick" number (xTaskGetTickCount() value) or a
+ * "delay" in milliseconds. Such commands are handed to cmd_sched and only their
+ * scheduling ACK and ID are answered. Once executed, their answers are pushed to
+ * the client under the "SCHEDULED" key together with the execution tick and jitter.
+ */
+
+/**
+ * @brief 	Serializes a JSON value preceded by its length as JSON_WP_HEADER_LEN hex digits,
+ * 			so the whole response can be handed to the network stack in a single call.
+ * @param 	*value 		:JSON value to serialize
+ * @param 	*buff		:caller provided buffer, used if the response fits in it
+ * @param 	size		:size of the caller provided buffer
+ * @param   **tx_buff	:pointer to pointer, will be set to buff or to an allocated buffer
+ * 						 if the response doesn't fit. Must be released with json_wp_release()
+ * @returns	the length of the response including the header, 0 on failure
+ */
+int json_wp_serialize(JSON_Value const *value, char *buff, int size,
+		char **tx_buff)
+{
+	int body_len = json_serialization_size(value); /* returns 0 on fail */
+	int buff_len = body_len + JSON_WP_HEADER_LEN;
+
+	*tx_buff = NULL;
+	if (!body_len) {
+		return 0;
+	}
+
+	if (buff_len <= size) {
+		*tx_buff = buff;
+	} else {
+		*tx_buff = block_pool_malloc(buff_len);
+		if (!(*tx_buff)) {
+			lDebug(Error, "Out Of Memory");
+			return 0;
+		}
+	}
+
+	/* The header terminator is overwritten by the body */
+	sprintf(*tx_buff, "%04x", body_len);
+	json_serialize_to_buffer(value, *tx_buff + JSON_WP_HEADER_LEN, body_len);
+	return buff_len;
+}
+
+/**
+ * @brief 	Releases a response returned by json_wp_serialize() or json_wp()
+ * @param 	*buff		:caller provided buffer passed to json_wp_serialize()
+ * @param   *tx_buff	:response buffer, freed only if it was allocated
+ */
+void json_wp_release(char *buff, char *tx_buff)
+{
+	if (tx_buff && (tx_buff != buff)) {
+		block_pool_free(tx_buff);
+	}
+}
+
+/**
+ * @brief 	answers a command whose scheduling parameter is out of range.
+ * @param 	*par 	:name of the parameter
+ * @returns	JSON object with ACK false, caller must free it
  */
+static JSON_Value* json_wp_nack(char const *par)
+{
+	lDebug(Error, "Invalid %s", par);
+
+	JSON_Value *ans = json_value_init_object();
+	json_object_set_boolean(json_value_get_object(ans), "ACK", false);
+	return ans;
+}
 
 /**
  * @brief 	Parses the received JSON object looking for commands to execute and appends
  * 			the outputs of the called commands to the response buffer.
  * @param 	*rx_buff 	:pointer to the received buffer from the network
- * @param   **tx_buff	:pointer to pointer, will be set to the allocated return buffer
- * @returns	the length of the allocated response buffer
+ * @param 	*buff		:caller provided buffer for the response
+ * @param 	size		:size of the caller provided buffer
+ * @param   **tx_buff	:pointer to pointer, will be set to the response buffer
+ * @param 	defer		:hand the commands that may block to cmd_sched
+ * @returns	the length of the response buffer, header included
  */
-int json_wp(char *rx_buff, char **tx_buff)
+static int json_wp_run(char *rx_buff, char *buff, int size, char **tx_buff,
+		bool defer)
 {
+	json_arena_begin();
+
 	JSON_Value *rx_JSON_value = json_parse_string(rx_buff);
 	JSON_Value *tx_JSON_value = json_value_init_object();
 	*tx_buff = NULL;
@@ -67,7 +148,33 @@ int json_wp(char *rx_buff, char **tx_buff)
 				lDebug(Info, "Command Found: %s", command_name);
 				JSON_Value *pars = json_object_get_value(command, "pars");
 
-				JSON_Value *ans = cmd_execute(command_name, pars);
+				JSON_Value *ans;
+				if (json_object_has_value_of_type(command, "at_tick",
+						JSONNumber)) {
+					double at_tick = json_object_get_number(command,
+							"at_tick");
+					ans = (at_tick >= 0 && at_tick <= portMAX_DELAY) ?
+							cmd_sched_add(command_name, pars,
+									(TickType_t) at_tick) :
+							json_wp_nack("at_tick");
+				} else if (json_object_has_value_of_type(command, "delay",
+						JSONNumber)) {
+					double delay = json_object_get_number(command, "delay");
+					ans = (delay >= 0 && delay <= CMD_SCHED_MAX_DELAY_MS) ?
+							cmd_sched_add(command_name, pars,
+									xTaskGetTickCount()
+											+ pdMS_TO_TICKS((uint32_t) delay)) :
+							json_wp_nack("delay");
+				} else if (defer && command_name) {
+					/* Nor can it wait for a command run by cmd_sched */
+					if (cmd_may_block(command_name)
+							|| !cmd_try_execute(command_name, pars, &ans)) {
+						ans = cmd_sched_add(command_name, pars,
+								xTaskGetTickCount());
+					}
+				} else {
+					ans = cmd_execute(command_name, pars);
+				}
 				if (ans) {
 					json_object_set_value(json_value_get_object(tx_JSON_value),
 							command_name, ans);
@@ -75,16 +182,31 @@ int json_wp(char *rx_buff, char **tx_buff)
 			}
 		}
 
-		buff_len = json_serialization_size(tx_JSON_value); /* returns 0 on fail */
-		*tx_buff = pvPortMalloc(buff_len);
-		if (!(*tx_buff)) {
-			lDebug(Error, "Out Of Memory");
-			buff_len = 0;
-		} else {
-			json_serialize_to_buffer(tx_JSON_value, *tx_buff, buff_len);
-		}
+		buff_len = json_wp_serialize(tx_JSON_value, buff, size, tx_buff);
 	}
 	json_value_free(rx_JSON_value);
 	json_value_free(tx_JSON_value);
+
+	json_arena_end();
 	return buff_len;
 }
+
+/**
+ * @brief 	Executes the commands of a request, see json_wp_run().
+ */
+int json_wp(char *rx_buff, char *buff, int size, char **tx_buff)
+{
+	return json_wp_run(rx_buff, buff, size, tx_buff, false);
+}
+
+/**
+ * @brief 	Same as json_wp(), for callers that must not block. The commands
+ * 			that may block, or that find cmd_sched executing another
+ * 			command, are handed to cmd_sched for immediate execution,
+ * 			their scheduling ACK is answered and their result is pushed
+ * 			under the "SCHEDULED" key.
+ */
+int json_wp_nonblocking(char *rx_buff, char *buff, int size, char **tx_buff)
+{
+	return json_wp_run(rx_buff, buff, size, tx_buff, true);
+}
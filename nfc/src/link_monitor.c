@@ -0,0 +1,196 @@
+#include "link_monitor.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+#include "board.h"
+#include "lwip/tcpip.h"
+#include "lwip/snmp.h"
+#include "lpc_phy.h"
+#include "relay.h"
+#include "debug.h"
+#include "rtos_static.h"
+
+/**
+ * @struct 	link_monitor
+ * @brief	state of the monitor, only written from the timer task.
+ */
+struct link_monitor {
+	struct netif *netif;
+	TimerHandle_t timer;
+	uint32_t settle;			/* Polls left to skip after a change */
+	bool pending;				/* Link change not handed to lwIP yet */
+	uint32_t history_head;		/* Next history slot */
+	struct link_monitor_stats stats;
+};
+
+static struct link_monitor monitor;
+
+/**
+ * @brief 	adds a link change to the counters and the history.
+ * @note	called with the scheduler locked, see link_monitor_poll().
+ */
+static void link_monitor_record(bool up, TickType_t tick)
+{
+	struct link_monitor_stats *s = &monitor.stats;
+
+	s->up = up;
+	if (up) {
+		s->ups++;
+		s->last_up_tick = tick;
+	} else {
+		s->downs++;
+		s->last_down_tick = tick;
+	}
+
+	s->history[monitor.history_head].tick = tick;
+	s->history[monitor.history_head].up = up;
+	monitor.history_head = (monitor.history_head + 1) % LINK_MONITOR_HISTORY;
+	if (s->history_count < LINK_MONITOR_HISTORY) {
+		s->history_count++;
+	}
+}
+
+/**
+ * @brief 	timer callback, runs the PHY status state machine and forwards
+ * 			the link changes to the MAC and to lwIP.
+ * @note	runs in the timer task, must not block.
+ */
+static void link_monitor_poll(TimerHandle_t timer)
+{
+	if (monitor.settle) {
+		monitor.settle--;
+	} else {
+		uint32_t physts = lpcPHYStsPoll();
+
+		/* Only check for connection state when the PHY status has changed */
+		if (physts & PHY_LINK_CHANGED) {
+			bool up = (physts & PHY_LINK_CONNECTED) != 0;
+
+			if (up) {
+				/* Set interface speed and duplex */
+				if (physts & PHY_LINK_SPEED100) {
+					Chip_ENET_SetSpeed(LPC_ETHERNET, 1);
+					NETIF_INIT_SNMP(monitor.netif, snmp_ifType_ethernet_csmacd,
+							100000000);
+				} else {
+					Chip_ENET_SetSpeed(LPC_ETHERNET, 0);
+					NETIF_INIT_SNMP(monitor.netif, snmp_ifType_ethernet_csmacd,
+							10000000);
+				}
+				Chip_ENET_SetDuplex(LPC_ETHERNET,
+						(physts & PHY_LINK_FULLDUPLX) != 0);
+			}
+			relay_spare_led(up);
+
+			vTaskSuspendAll();
+			monitor.stats.speed100 = (physts & PHY_LINK_SPEED100) != 0;
+			monitor.stats.full_duplex = (physts & PHY_LINK_FULLDUPLX) != 0;
+			link_monitor_record(up, xTaskGetTickCount());
+			xTaskResumeAll();
+
+			lDebug(Info, "Link %s, %d Mbps %s duplex", up ? "up" : "down",
+					(physts & PHY_LINK_SPEED100) ? 100 : 10,
+					(physts & PHY_LINK_FULLDUPLX) ? "full" : "half");
+
+			monitor.pending = true;
+			/* Delay for link detection */
+			monitor.settle = LINK_MONITOR_SETTLE_MS / LINK_MONITOR_PERIOD_MS;
+		}
+	}
+	monitor.stats.polls++;
+
+	/* The timer task can't wait for room in the tcpip mailbox, a full one
+	 * is retried on the next poll */
+	if (monitor.pending) {
+		tcpip_callback_fn fn =
+				monitor.stats.up ?
+						(tcpip_callback_fn) netif_set_link_up :
+						(tcpip_callback_fn) netif_set_link_down;
+		if (tcpip_callback_with_block(fn, monitor.netif, 0) == ERR_OK) {
+			monitor.pending = false;
+		}
+	}
+}
+
+/**
+ * @brief 	starts monitoring the PHY link of an interface.
+ * @param 	*netif	:interface to report the link changes to
+ * @returns	nothing
+ * @note	call once the interface is added and the PHY initialized.
+ */
+void link_monitor_init(struct netif *netif)
+{
+	monitor.netif = netif;
+
+	monitor.timer = rtos_timer_create("LinkMon",
+			pdMS_TO_TICKS(LINK_MONITOR_PERIOD_MS), pdTRUE, link_monitor_poll,
+			RTOS_BANK_RAMLOC32);
+	if (!monitor.timer || (xTimerStart(monitor.timer, portMAX_DELAY) != pdPASS)) {
+		lDebug(Error, "Unable to start the link monitor");
+		return;
+	}
+	lDebug(Info, "LinkMon: timer started");
+}
+
+/**
+ * @brief 	returns the link state and its changes.
+ * @param 	*stats	:pointer to the structure to fill, history oldest first
+ * @returns	nothing
+ */
+void link_monitor_get_stats(struct link_monitor_stats *stats)
+{
+	vTaskSuspendAll();
+	*stats = monitor.stats;
+	uint32_t head = monitor.history_head;
+	xTaskResumeAll();
+
+	/* Rotate the ring so the oldest event comes first */
+	if (stats->history_count == LINK_MONITOR_HISTORY) {
+		struct link_event ring[LINK_MONITOR_HISTORY];
+		memcpy(ring, stats->history, sizeof(ring));
+		for (uint32_t i = 0; i < LINK_MONITOR_HISTORY; i++) {
+			stats->history[i] = ring[(head + i) % LINK_MONITOR_HISTORY];
+		}
+	}
+}
+
+/**
+ * @brief 	returns the link state, the flap counters and the last changes.
+ * @returns	JSON object, caller must free it
+ */
+JSON_Value* link_monitor_json(void)
+{
+	struct link_monitor_stats s;
+	link_monitor_get_stats(&s);
+
+	JSON_Value *ans = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(ans);
+
+	json_object_set_boolean(obj, "UP", s.up);
+	json_object_set_number(obj, "SPEED", s.speed100 ? 100 : 10);
+	json_object_set_boolean(obj, "FULL_DUPLEX", s.full_duplex);
+	json_object_set_number(obj, "UPS", s.ups);
+	json_object_set_number(obj, "FLAPS", s.downs);
+	json_object_set_number(obj, "LAST_UP_TICK", s.last_up_tick);
+	json_object_set_number(obj, "LAST_DOWN_TICK", s.last_down_tick);
+	json_object_set_number(obj, "POLLS", s.polls);
+
+	JSON_Value *history = json_value_init_array();
+	for (uint32_t i = 0; i < s.history_count; i++) {
+		JSON_Value *event = json_value_init_object();
+		JSON_Object *event_obj = json_value_get_object(event);
+		json_object_set_number(event_obj, "TICK", s.history[i].tick);
+		json_object_set_boolean(event_obj, "UP", s.history[i].up);
+		json_array_append_value(json_value_get_array(history), event);
+	}
+	json_object_set_value(obj, "HISTORY", history);
+
+	json_object_set_number(obj, "TICK", xTaskGetTickCount());
+	return ans;
+}
@@ -0,0 +1,172 @@
+#include "log_server.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lwip/sockets.h"
+#include "debug.h"
+#include "rtos_static.h"
+
+#define LOG_SERVER_TASK_PRIORITY 	( tskIDLE_PRIORITY + 1 )
+#define LOG_SERVER_IDLE_CHECK_MS	1000
+
+static char log_server_buf[1024];
+
+/* Port to listen on, changed by log_server_restart() */
+static volatile uint16_t log_server_port;
+
+/**
+ * @brief 	sends the network log lines to the connected client as they are
+ * 			produced, one "<seq> <line>\n" per line. Starts with the oldest
+ * 			line still in the ring. Gaps in seq mean lines were lost.
+ * @param 	sock	:connected socket
+ * @param 	port	:port the client connected to, the stream ends when
+ * 					 log_server_restart() moves the server
+ */
+static void log_server_stream(const int sock, uint16_t port)
+{
+	char line[DEBUG_NET_LINE_LEN];
+	uint32_t seq = 0;
+
+	while (true) {
+		int len = 0;
+
+		while ((len < (int) (sizeof(log_server_buf) - sizeof(line) - 12))
+				&& debugNetRead(&seq, line, sizeof(line))) {
+			len += snprintf(log_server_buf + len, sizeof(log_server_buf) - len,
+					"%lu %s\n", seq, line);
+			seq++;
+		}
+
+		if (len) {
+			int to_write = len;
+			while (to_write > 0) {
+				int written = send(sock, log_server_buf + (len - to_write),
+						to_write, 0);
+				if (written < 0) {
+					return;
+				}
+				to_write -= written;
+			}
+			continue;
+		}
+
+		/* Nothing to send. Sleep until the Debug task adds a line, checking
+		 * from time to time if the client went away */
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_SERVER_IDLE_CHECK_MS));
+		if (port != log_server_port) {
+			return;
+		}
+
+		char c;
+		int ret = recv(sock, &c, sizeof(c), MSG_DONTWAIT);
+		if ((ret == 0) || ((ret < 0) && (errno != EWOULDBLOCK))) {
+			return;
+		}
+	}
+}
+
+/**
+ * @brief 	creates the listening socket.
+ * @param 	port	:TCP port to listen on
+ * @returns	the socket, -1 on error
+ */
+static int log_server_listen(uint16_t port)
+{
+	int accept_timeout = LOG_SERVER_IDLE_CHECK_MS;
+	struct sockaddr_in dest_addr;
+
+	dest_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	dest_addr.sin_family = AF_INET;
+	dest_addr.sin_port = htons(port);
+
+	int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+	if (listen_sock < 0) {
+		lDebug(Error, "Log server: unable to create socket: errno %d", errno);
+		return -1;
+	}
+	int opt = 1;
+	setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+	// accept() returns EWOULDBLOCK once in a while to check the port
+	setsockopt(listen_sock, SOL_SOCKET, SO_RCVTIMEO, &accept_timeout,
+			sizeof(int));
+
+	if ((bind(listen_sock, (struct sockaddr*) &dest_addr, sizeof(dest_addr))
+			!= 0) || (listen(listen_sock, 1) != 0)) {
+		lDebug(Error, "Log server: unable to listen: errno %d", errno);
+		close(listen_sock);
+		return -1;
+	}
+	lDebug(Info, "Log server listening, port %d", port);
+	return listen_sock;
+}
+
+static void log_server_task(void *pvParameters)
+{
+	int listen_sock = -1;
+	uint16_t port = 0;
+
+	debugNetSetListener(xTaskGetCurrentTaskHandle());
+
+	while (true) {
+		/* (Re)started on the port set by log_server_restart() */
+		if (port != log_server_port) {
+			if (listen_sock >= 0) {
+				close(listen_sock);
+			}
+			port = log_server_port;
+			listen_sock = log_server_listen(port);
+		}
+		if (listen_sock < 0) {
+			/* Retried until it succeeds or the port changes */
+			vTaskDelay(pdMS_TO_TICKS(LOG_SERVER_IDLE_CHECK_MS));
+			port = 0;
+			continue;
+		}
+
+		struct sockaddr source_addr;
+		socklen_t addr_len = sizeof(source_addr);
+		int sock = accept(listen_sock, &source_addr, &addr_len);
+		if (sock < 0) {
+			if (errno != EWOULDBLOCK) {
+				lDebug(Error, "Log server: unable to accept connection: errno %d",
+						errno);
+			}
+			continue;
+		}
+
+		lDebug(Info, "Log server: client connected");
+		log_server_stream(sock, port);
+		lDebug(Info, "Log server: client disconnected");
+
+		shutdown(sock, 0);
+		close(sock);
+	}
+}
+
+/**
+ * @brief 	creates the task streaming the network log over TCP.
+ * @param 	port	: TCP port to listen on
+ * @returns	nothing
+ */
+void log_server_init(uint16_t port)
+{
+	log_server_port = port;
+	rtos_task_create(log_server_task, "LogServer", configMINIMAL_STACK_SIZE * 4,
+			NULL, LOG_SERVER_TASK_PRIORITY, RTOS_BANK_RAMAHB);
+}
+
+/**
+ * @brief 	moves the listener to another port, dropping the client.
+ * @param 	port	:TCP port to listen on
+ * @returns	nothing
+ * @note	the task notices it within LOG_SERVER_IDLE_CHECK_MS.
+ */
+void log_server_restart(uint16_t port)
+{
+	log_server_port = port;
+}
@@ -17,12 +17,45 @@
 #include "board.h"
 #include "relay.h"
 #include "arch/lpc18xx_43xx_emac.h"
+#include "lpc_18xx43xx_emac_config.h"
 #include "arch/lpc_arch.h"
 #include "arch/sys_arch.h"
-#include "lpc_phy.h" /* For the PHY monitor support */
+#include "link_monitor.h"
 #include "settings.h"
 #include "tcp_server.h"
+#include "tcp_server_raw.h"
+#include "net_reconfig.h"
+#include "telemetry_udp.h"
+#include "log_server.h"
 #include "debug.h"
+#include "rtos_static.h"
+
+/* The lwIP TCP sanity checks are disabled for the one comparing TCP_WND
+   with an empty PBUF_POOL, see lwipopts.h. Received frames stay in the
+   driver buffers until lwIP frees them */
+#if LWIP_TCP
+#if TCP_WND > ((LPC_NUM_RX_PBUFS - LPC_NUM_BUFF_RXDESCS) * TCP_MSS)
+#error "TCP_WND is larger than the RX buffers lwIP can hold, see LPC_NUM_RX_PBUFS"
+#endif
+#if TCP_WND < TCP_MSS
+#error "TCP_WND is smaller than TCP_MSS"
+#endif
+#if MEMP_NUM_TCP_SEG < TCP_SND_QUEUELEN
+#error "MEMP_NUM_TCP_SEG should be at least TCP_SND_QUEUELEN"
+#endif
+#if TCP_SND_BUF < (2 * TCP_MSS)
+#error "TCP_SND_BUF must be at least 2 * TCP_MSS"
+#endif
+#if TCP_SND_QUEUELEN < (2 * (TCP_SND_BUF / TCP_MSS))
+#error "TCP_SND_QUEUELEN must be at least 2 * TCP_SND_BUF / TCP_MSS"
+#endif
+#if TCP_SNDLOWAT >= TCP_SND_BUF
+#error "TCP_SNDLOWAT must be less than TCP_SND_BUF"
+#endif
+#if TCP_SNDQUEUELOWAT >= TCP_SND_QUEUELEN
+#error "TCP_SNDQUEUELOWAT must be less than TCP_SND_QUEUELEN"
+#endif
+#endif
 
 #define ip_addr_print(ipaddr) \
   printf("IP ADDRESS FROM EEPROM = %hhu.%hhu.%hhu.%hhu",         \
@@ -51,12 +84,10 @@ static void tcpip_init_done_signal(void *arg)
 	*(s32_t *) arg = 1;
 }
 
-/* LWIP kickoff and PHY link monitor thread */
+/* LWIP kickoff thread, deletes itself once the link monitor is running */
 void vStackIpSetup(void *pvParameters) {
 	ip_addr_t ipaddr, netmask, gw;
 	volatile s32_t tcpipdone = 0;
-	uint32_t physts;
-	static int prt_ip = 0;
 
 	/* Wait until the TCP/IP thread is finished before
 	   continuing or wierd things may happen */
@@ -98,62 +129,30 @@ void vStackIpSetup(void *pvParameters) {
 #endif
 
 	/* Initialize and start application */
+#if TCP_SERVER_RAW
+	tcp_server_raw_init(settings.port);
+#else
 	stackIp_ThreadInit(settings.port);
+#endif
+	net_reconfig_init(settings.port);
+	telemetry_udp_init(settings);
+	log_server_init(settings.port + LOG_SERVER_PORT_OFFSET);
+
+	rtos_memory_map_report();
 
-	/* This loop monitors the PHY link and will handle cable events
-	   via the PHY driver. */
-	while (1) {
-		/* Call the PHY status update state machine once in a while
-		   to keep the link status up-to-date */
-		physts = lpcPHYStsPoll();
-
-		/* Only check for connection state when the PHY status has changed */
-		if (physts & PHY_LINK_CHANGED) {
-			if (physts & PHY_LINK_CONNECTED) {
-				relay_spare_led(1); /* HIGH */
-				prt_ip = 0;
-
-				/* Set interface speed and duplex */
-				if (physts & PHY_LINK_SPEED100) {
-					Chip_ENET_SetSpeed(LPC_ETHERNET, 1);
-					NETIF_INIT_SNMP(&lpc_netif, snmp_ifType_ethernet_csmacd, 100000000);
-				}
-				else {
-					Chip_ENET_SetSpeed(LPC_ETHERNET, 0);
-					NETIF_INIT_SNMP(&lpc_netif, snmp_ifType_ethernet_csmacd, 10000000);
-				}
-				if (physts & PHY_LINK_FULLDUPLX) {
-					Chip_ENET_SetDuplex(LPC_ETHERNET, true);
-				}
-				else {
-					Chip_ENET_SetDuplex(LPC_ETHERNET, false);
-				}
-
-				tcpip_callback_with_block((tcpip_callback_fn) netif_set_link_up,
-										  (void *) &lpc_netif, 1);
-			}
-			else {
-				relay_spare_led(0); /* LOW */
-				tcpip_callback_with_block((tcpip_callback_fn) netif_set_link_down,
-										  (void *) &lpc_netif, 1);
-			}
-
-			DEBUGOUT("Link connect status: %d\r\n", ((physts & PHY_LINK_CONNECTED) != 0));
-
-			/* Delay for link detection (250mS) */
-			vTaskDelay(configTICK_RATE_HZ / 4);
-		}
-
-		/* Print IP address info */
-	if (!prt_ip) {
-			if (lpc_netif.ip_addr.addr) {
-				static char tmp_buff[16];
-				DEBUGOUT("\n\n\r - NASA GSPC - \n SM-13 New Fixture Controller Remote Terminal Unit. \n Attempting to open interface.\n\n\r");
-				DEBUGOUT("IP_ADDR    : %s\r\n", ipaddr_ntoa_r((const ip_addr_t *) &lpc_netif.ip_addr, tmp_buff, 16));
-				DEBUGOUT("NET_MASK   : %s\r\n", ipaddr_ntoa_r((const ip_addr_t *) &lpc_netif.netmask, tmp_buff, 16));
-				DEBUGOUT("GATEWAY_IP : %s\r\n", ipaddr_ntoa_r((const ip_addr_t *) &lpc_netif.gw, tmp_buff, 16));
-				prt_ip = 1;
-			}
-		}
+	/* The PHY link is monitored from a software timer from now on */
+	link_monitor_init(&lpc_netif);
+
+	/* Print IP address info, once DHCP got one */
+	while (!lpc_netif.ip_addr.addr) {
+		vTaskDelay(configTICK_RATE_HZ / 4);
 	}
+
+	static char tmp_buff[16];
+	DEBUGOUT("\n\n\r - NASA GSPC - \n SM-13 New Fixture Controller Remote Terminal Unit. \n Attempting to open interface.\n\n\r");
+	DEBUGOUT("IP_ADDR    : %s\r\n", ipaddr_ntoa_r((const ip_addr_t *) &lpc_netif.ip_addr, tmp_buff, 16));
+	DEBUGOUT("NET_MASK   : %s\r\n", ipaddr_ntoa_r((const ip_addr_t *) &lpc_netif.netmask, tmp_buff, 16));
+	DEBUGOUT("GATEWAY_IP : %s\r\n", ipaddr_ntoa_r((const ip_addr_t *) &lpc_netif.gw, tmp_buff, 16));
+
+	vTaskDelete(NULL);
 }
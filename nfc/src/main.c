@@ -27,11 +27,18 @@
 #include "tcp_server.h"
 #include "mem_check.h"
 #include "encoders.h"
+#include "block_pool.h"
+#include "json_arena.h"
+#include "cmd_sched.h"
+#include "net_commands.h"
+#include "uart_tx.h"
+#include "rtos_static.h"
+#include "mem_sections.h"
 
 extern struct gpio_entry relay_1;
 
 /* GPa 201117 1850 Iss2: agregado de Heap_4.c*/
-uint8_t __attribute__((section ("." "data" ".$" "RamLoc40"))) ucHeap[configTOTAL_HEAP_SIZE];
+uint8_t BSS_RAMLOC40 ucHeap[configTOTAL_HEAP_SIZE];
 
 /* Sets up system hardware */
 static void prvSetupHardware(void)
@@ -49,8 +56,11 @@ static void prvSetupHardware(void)
 	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
 	debugInit();
+	block_pool_init();
+	json_arena_init();
 
 	Board_Init();
+	uart_tx_init(UART_TX_DROP);
 	settings_init();
 	//settings_erase();
 	relay_init();
@@ -63,6 +73,8 @@ static void prvSetupHardware(void)
 	//temperature_ds18b20_init();
 	encoders_init();
 	mem_check_init();
+	net_commands_init();
+	cmd_sched_init();
 
 
 }
@@ -93,9 +105,9 @@ int main(void)
 	prvSetupHardware();
 
 	/* Task - Ethernet PHY Initialization  */
-	xTaskCreate(vStackIpSetup, "StackIpSetup",
+	rtos_task_create(vStackIpSetup, "StackIpSetup",
 	configMINIMAL_STACK_SIZE * 4, NULL, (tskIDLE_PRIORITY + 1UL),
-			(xTaskHandle*) NULL);
+			RTOS_BANK_RAMAHB);
 
 	/* Start the scheduler itself. */
 	vTaskStartScheduler();
@@ -1,28 +1,146 @@
+#include "mem_check.h"
+
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 
+#include "FreeRTOS.h"
+#include "task.h"
 #include "board.h"
 #include "debug.h"
+#include "rtos_static.h"
 
 #define MEM_CHECK_TASK_PRIORITY ( 0 )
 
+#if MEM_CHECK_IDLE_HOOK && (configUSE_IDLE_HOOK == 0)
+#error "MEM_CHECK_IDLE_HOOK requires configUSE_IDLE_HOOK"
+#endif
+
+/**
+ * @struct 	mem_check_timing
+ * @brief	cost of the incremental scanner, in CPU cycles.
+ */
+struct mem_check_timing {
+	uint32_t slices;
+	uint32_t last_slice_cycles;
+	uint32_t max_slice_cycles;
+	uint32_t pass_ms;			/* Duration of the last completed pass */
+	TickType_t pass_start;
+};
+
+static struct mem_check_timing timing;
+
+/**
+ * @brief 	runs a slice of the scanner, measuring how long it takes.
+ * @returns	true if the slice completed a pass
+ */
+static bool mem_check_slice(void)
+{
+	uint32_t start = DWT->CYCCNT;
+	bool done = xPortMemoryScanStep(MEM_CHECK_SLICE_WORDS);
+	uint32_t cycles = DWT->CYCCNT - start;
+
+	timing.slices++;
+	timing.last_slice_cycles = cycles;
+	if (cycles > timing.max_slice_cycles) {
+		timing.max_slice_cycles = cycles;
+	}
+
+	if (done) {
+		TickType_t now = xTaskGetTickCount();
+		timing.pass_ms = (now - timing.pass_start) * portTICK_PERIOD_MS;
+	}
+	return done;
+}
 
+#if MEM_CHECK_IDLE_HOOK
+/**
+ * @brief 	idle hook, runs at most one scanner slice per tick and lets
+ * 			MEM_CHECK_PASS_PERIOD_MS elapse between passes.
+ */
+void vApplicationIdleHook(void)
+{
+	static TickType_t last_slice;
+	static bool waiting = false;
+	TickType_t now = xTaskGetTickCount();
+
+	if (waiting) {
+		if ((now - timing.pass_start) < pdMS_TO_TICKS(MEM_CHECK_PASS_PERIOD_MS)) {
+			return;
+		}
+		waiting = false;
+		timing.pass_start = now;
+	}
+
+	if (now == last_slice) {
+		return;
+	}
+	last_slice = now;
+
+	waiting = mem_check_slice();
+}
+#else
 static void mem_check_task(void *par)
 {
 	while (true) {
-		vPortCheckIntegrity();
-		vPortMemoryScan();
+		timing.pass_start = xTaskGetTickCount();
+		while (!mem_check_slice()) {
+			vTaskDelay(1);
+		}
 
-		vTaskDelay(pdMS_TO_TICKS(5000));
+		vTaskDelayUntil(&timing.pass_start,
+				pdMS_TO_TICKS(MEM_CHECK_PASS_PERIOD_MS));
 	}
 }
+#endif
 
 /**
- * @brief 	initializes ADC to read temperature sensor.
+ * @brief 	starts the incremental leak and overflow scanner.
  * @return	nothing
  */
 void mem_check_init()
 {
-	xTaskCreate(mem_check_task, "MemCheck", configMINIMAL_STACK_SIZE * 2, NULL,
-			MEM_CHECK_TASK_PRIORITY, NULL);
+#if MEM_CHECK_IDLE_HOOK
+	timing.pass_start = xTaskGetTickCount();
+	lDebug(Info, "MemCheck: running from the idle hook");
+#else
+	rtos_task_create(mem_check_task, "MemCheck", configMINIMAL_STACK_SIZE * 2,
+			NULL, MEM_CHECK_TASK_PRIORITY, RTOS_BANK_RAMAHB);
 	lDebug(Info, "MemCheck: task created");
+#endif
+}
+
+/**
+ * @brief 	returns the scanner progress, its cost and its findings.
+ * @returns	JSON object, caller must free it
+ */
+JSON_Value* mem_check_json(void)
+{
+	HeapScanStatus_t status;
+	vPortGetMemoryScanStatus(&status);
+
+	JSON_Value *ans = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(ans);
+
+	json_object_set_number(obj, "PASSES", status.ulPasses);
+	json_object_set_number(obj, "BLOCKS_ALLOCATED", status.ulBlocksAllocated);
+	json_object_set_number(obj, "BLOCKS_SCANNED", status.ulBlocksScanned);
+	json_object_set_number(obj, "SLICE_WORDS", MEM_CHECK_SLICE_WORDS);
+	json_object_dotset_number(obj, "SLICE.COUNT", timing.slices);
+	json_object_dotset_number(obj, "SLICE.LAST_US",
+			timing.last_slice_cycles / (SystemCoreClock / 1000000));
+	json_object_dotset_number(obj, "SLICE.MAX_US",
+			timing.max_slice_cycles / (SystemCoreClock / 1000000));
+	json_object_set_number(obj, "PASS_MS", timing.pass_ms);
+	json_object_dotset_number(obj, "FINDINGS.OVERFLOWS", status.ulOverflows);
+	json_object_dotset_number(obj, "FINDINGS.ORPHANS", status.ulOrphans);
+	if (status.ulLastFinding) {
+		json_object_dotset_number(obj, "FINDINGS.LAST.ADDRESS",
+				status.ulLastFinding);
+		json_object_dotset_number(obj, "FINDINGS.LAST.SIZE",
+				status.ulLastFindingSize);
+		json_object_dotset_string(obj, "FINDINGS.LAST.OWNER",
+				status.pcLastFindingOwner);
+	}
+	return ans;
 }
@@ -1,3 +1,8 @@
+/* Debug call sites are compiled out, the rest can be tuned at runtime with
+ * the LOG_LEVEL command */
+#define LOG_MODULE_NAME		"mot_pap"
+#define LOG_MODULE_LEVEL	Info
+
 #include "mot_pap.h"
 
 #include <stdint.h>
@@ -12,6 +17,8 @@
 #include "debug.h"
 #include "relay.h"
 #include "tmr.h"
+#include "rtos_static.h"
+#include "mem_sections.h"
 
 extern bool stall_detection;
 extern int count_a;
@@ -29,12 +36,15 @@ QueueHandle_t mot_pap_supervisor_task_queue = NULL;
 
 void mot_pap_init()
 {
-	mot_pap_supervisor_task_queue = xQueueCreate(1, sizeof(struct mot_pap*));
+	debugModuleThisRegister();
+
+	mot_pap_supervisor_task_queue = rtos_queue_create(1, sizeof(struct mot_pap*),
+			RTOS_BANK_RAMLOC32);
 
 	if (mot_pap_supervisor_task_queue != NULL) {
 		// Create the 'handler' task, which is the task to which interrupt processing is deferred
-		xTaskCreate(mot_pap_supervisor_task, "mot_pap", 2048,
-		NULL, MOT_PAP_SUPERVISOR_TASK_PRIORITY, NULL);
+		rtos_task_create(mot_pap_supervisor_task, "mot_pap", 2048,
+		NULL, MOT_PAP_SUPERVISOR_TASK_PRIORITY, RTOS_BANK_RAMLOC40);
 		lDebug(Info, "supervisor task created");
 	}
 
@@ -288,7 +298,7 @@ void mot_pap_supervisor_task()
  * @brief 	function called by the timer ISR to generate the output pulses
  * @param 	me : struct mot_pap pointer
  */
-void mot_pap_isr(struct mot_pap *me)
+void RAMFUNC mot_pap_isr(struct mot_pap *me)
 {
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 	me->posAct = count_a;
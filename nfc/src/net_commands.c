@@ -4,18 +4,39 @@
 #include <x_axis.h>
 #include "debug.h"
 #include "FreeRTOS.h"
+#include "semphr.h"
 
 #include "net_commands.h"
 #include "parson.h"
 #include "json_wp.h"
+#include "json_arena.h"
+#include "block_pool.h"
 #include "settings.h"
 #include "temperature_ds18b20.h"
 #include "relay.h"
+#include "telemetry.h"
+#include "telemetry_udp.h"
+#include "uart_tx.h"
+#include "mem_check.h"
+#include "isr_stats.h"
+#include "link_monitor.h"
+#include "net_reconfig.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+#include "lwip/sys.h"
+#include "lwip/sockets.h"
+#include "arch/lpc18xx_43xx_emac.h"
+#include "tcp_server.h"
+#include "rtos_static.h"
 
 #define PROTOCOL_VERSION  	"JSON_1.0"
 
 extern QueueHandle_t mot_pap_queue;
 
+/* The command functions aren't reentrant. Serializes the command servers
+   and cmd_sched */
+static SemaphoreHandle_t cmd_mutex;
+
 bool stall_detection = true;
 extern int count_z;
 extern int count_b;
@@ -29,6 +50,7 @@ extern struct mot_pap z_axis;
 typedef struct {
 	char *cmd_name;
 	JSON_Value* (*cmd_function)(JSON_Value const *pars);
+	bool may_block;		/* Moves the axes, or waits on the EEPROM */
 } cmd_entry;
 
 JSON_Value* telemetria_cmd(JSON_Value const *pars)
@@ -44,31 +66,116 @@ JSON_Value* telemetria_cmd(JSON_Value const *pars)
 
 }
 
+JSON_Value* subscribe_cmd(JSON_Value const *pars)
+{
+	uint32_t fields = TELEMETRY_ALL;
+	uint32_t period_ms = TELEMETRY_DEFAULT_PERIOD_MS;
+	bool delta = false;
+
+	if (pars && json_value_get_type(pars) == JSONObject) {
+		JSON_Object const *pars_object = json_value_get_object(pars);
+
+		fields = telemetry_fields_from_json(
+				json_object_get_array(pars_object, "fields"));
+
+		double rate = json_object_get_number(pars_object, "rate");
+		if (rate > 0) {
+			period_ms = (uint32_t) (1000 / rate);
+		}
+
+		char const *mode = json_object_get_string(pars_object, "mode");
+		delta = mode && (strcmp(mode, "delta") == 0);
+	}
+
+	bool subscribed = telemetry_subscribe(fields, period_ms, delta);
+
+	JSON_Value *ans = json_value_init_object();
+	json_object_set_boolean(json_value_get_object(ans), "ACK", subscribed);
+	return ans;
+}
+
+JSON_Value* unsubscribe_cmd(JSON_Value const *pars)
+{
+	telemetry_unsubscribe();
+
+	JSON_Value *ans = json_value_init_object();
+	json_object_set_boolean(json_value_get_object(ans), "ACK", true);
+	return ans;
+}
+
+JSON_Value* telemetry_udp_cmd(JSON_Value const *pars)
+{
+	if (pars && json_value_get_type(pars) == JSONObject) {
+		JSON_Object *obj = json_value_get_object(pars);
+		char const *addr = json_object_get_string(obj, "addr");
+
+		struct settings settings = settings_read();
+
+		if (addr && !ipaddr_aton(addr, &settings.telemetry_addr)) {
+			lDebug(Warn, "Invalid telemetry address: %s", addr);
+			return NULL;
+		}
+		/* Omitted values keep the stored ones */
+		if (json_object_has_value_of_type(obj, "port", JSONNumber)) {
+			double port = json_object_get_number(obj, "port");
+			if (!(port >= 1 && port <= UINT16_MAX)) {
+				lDebug(Warn, "Invalid telemetry port");
+				return NULL;
+			}
+			settings.telemetry_port = (uint16_t) port;
+		}
+		if (json_object_has_value_of_type(obj, "rate", JSONNumber)) {
+			double rate = json_object_get_number(obj, "rate");
+			if (!(rate >= 0 && rate <= SETTINGS_TELEMETRY_MAX_RATE)) {
+				lDebug(Warn, "Invalid telemetry rate");
+				return NULL;
+			}
+			settings.telemetry_rate = (uint16_t) rate;
+		}
+
+		lDebug(Info, "Received UDP telemetry settings: addr:%s, port:%d, rate:%d",
+				addr ? addr : "-", settings.telemetry_port,
+				settings.telemetry_rate);
+
+		telemetry_udp_config(settings.telemetry_addr, settings.telemetry_port,
+				settings.telemetry_rate);
+		settings_save(settings);
+	}
+
+	return telemetry_udp_json();
+}
+
 JSON_Value* logs_cmd(JSON_Value const *pars)
 {
+	/* Sequence number of the next line to return */
+	static uint32_t logs_seq = 0;
+
 	if (pars && json_value_get_type(pars) == JSONObject) {
 		double quantity = json_object_get_number(json_value_get_object(pars),
 				"quantity");
 
 		JSON_Value *ans = json_value_init_object();
 		JSON_Value *msg_array = json_value_init_array();
+		char line[DEBUG_NET_LINE_LEN];
+		uint32_t lost = 0;
 
-		int msgs_waiting = uxQueueMessagesWaiting(debug_queue);
-
-		int extract = MIN(quantity, msgs_waiting);
-
-		for (int x = 0; x < extract; x++) {
-			char *dbg_msg = NULL;
-			if (xQueueReceive(debug_queue, &dbg_msg, (TickType_t) 0) == pdPASS) {
-				json_array_append_string(json_value_get_array(msg_array),
-						dbg_msg);
-				vPortFree(dbg_msg);
-				dbg_msg = NULL;
+		for (int x = 0; x < quantity; x++) {
+			uint32_t seq = logs_seq;
+			if (!debugNetRead(&seq, line, sizeof(line))) {
+				break;
 			}
+			lost += seq - logs_seq;
+			logs_seq = seq + 1;
+			json_array_append_string(json_value_get_array(msg_array), line);
 		}
 
 		json_object_set_value(json_value_get_object(ans), "DEBUG_MSGS",
 				msg_array);
+		json_object_set_number(json_value_get_object(ans), "DEBUG_LOST", lost);
+		json_object_set_number(json_value_get_object(ans), "DEBUG_DROPPED",
+				debugDropped());
+		json_object_set_number(json_value_get_object(ans), "UART_DROPPED",
+				uart_tx_dropped());
 
 		return ans;
 
@@ -199,6 +306,92 @@ JSON_Value* axis_stop_cmd(JSON_Value const *pars)
 	return ans;
 }
 
+/**
+ * @brief 	translates a level name into an enum debugLevels value.
+ * @param 	*name 	:level name, "Default" gives DEBUG_MODULE_DEFAULT
+ * @param 	*level 	:set to the level if the name is known
+ * @returns	false for missing or unknown names, level is left untouched
+ */
+static bool log_level_from_name(char const *name, int *level)
+{
+	enum debugLevels levels[] = { Debug, Info, Warn, Error };
+
+	if (!name) {
+		return false;
+	}
+	for (int i = 0; i < (sizeof(levels) / sizeof(levels[0])); i++) {
+		if (!strcmp(name, levelText(levels[i]))) {
+			*level = levels[i];
+			return true;
+		}
+	}
+	if (!strcmp(name, "Default")) {
+		*level = DEBUG_MODULE_DEFAULT;
+		return true;
+	}
+	return false;
+}
+
+JSON_Value* log_level_cmd(JSON_Value const *pars)
+{
+	bool ack = true;
+
+	if (pars && json_value_get_type(pars) == JSONObject) {
+		JSON_Object const *obj = json_value_get_object(pars);
+		char const *module_name = json_object_get_string(obj, "module");
+		char const *level = json_object_get_string(obj, "level");
+		char const *local = json_object_get_string(obj, "local");
+		char const *net = json_object_get_string(obj, "net");
+		int lvl;
+
+		/* Unknown names are rejected instead of falling back to Default */
+		if (module_name) {
+			struct debugModule *module = debugModuleFind(module_name);
+			if (module && log_level_from_name(level, &lvl)) {
+				module->level = lvl;
+			} else {
+				ack = false;
+			}
+		}
+		/* The global levels have no Default to fall back to */
+		if (local) {
+			if (log_level_from_name(local, &lvl)
+					&& (lvl != DEBUG_MODULE_DEFAULT)) {
+				debugLocalSetLevel(lvl);
+			} else {
+				ack = false;
+			}
+		}
+		if (net) {
+			if (log_level_from_name(net, &lvl)
+					&& (lvl != DEBUG_MODULE_DEFAULT)) {
+				debugNetSetLevel(lvl);
+			} else {
+				ack = false;
+			}
+		}
+	}
+
+	JSON_Value *ans = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(ans);
+	json_object_set_boolean(obj, "ACK", ack);
+	json_object_set_string(obj, "LOCAL", levelText(debugLocalLevel));
+	json_object_set_string(obj, "NET", levelText(debugNetLevel));
+
+	JSON_Value *modules = json_value_init_object();
+	for (struct debugModule *m = debugModuleFirst(); m; m = m->next) {
+		JSON_Value *module = json_value_init_object();
+		json_object_set_string(json_value_get_object(module), "COMPILED",
+				levelText(m->compiled));
+		json_object_set_string(json_value_get_object(module), "LEVEL",
+				(m->level == DEBUG_MODULE_DEFAULT) ?
+						"Default" : levelText(m->level));
+		json_object_set_value(json_value_get_object(modules), m->name, module);
+	}
+	json_object_set_value(obj, "MODULES", modules);
+	return ans;
+}
+
 JSON_Value* network_settings_cmd(JSON_Value const *pars)
 {
 	if (pars && json_value_get_type(pars) == JSONObject) {
@@ -210,13 +403,14 @@ JSON_Value* network_settings_cmd(JSON_Value const *pars)
 				json_value_get_object(pars), "netmask");
 		uint16_t port = (uint16_t) json_object_get_number(
 				json_value_get_object(pars), "port");
+		bool ack = true;
 
 		if (gw && ipaddr && netmask && port != 0) {
 			lDebug(Info,
 					"Received network settings: gw:%s, ipaddr:%s, netmask:%s, port:%d",
 					gw, ipaddr, netmask, port);
 
-			struct settings settings;
+			struct settings settings = settings_read();
 
 			unsigned char *gw_bytes = (unsigned char*) &(settings.gw.addr);
 			if (sscanf(gw, "%hhu.%hhu.%hhu.%hhu", &gw_bytes[0], &gw_bytes[1],
@@ -239,21 +433,80 @@ JSON_Value* network_settings_cmd(JSON_Value const *pars)
 
 			settings.port = port;
 
-			settings_save(settings);
-			lDebug(Info, "Settings saved. Restarting...");
-
-			Chip_UART_SendBlocking(DEBUG_UART, "\n\n", 2);
-
-			Chip_RGU_TriggerReset(RGU_CORE_RST);
+			/* Applied live once this answer is sent. With rollback_ms the
+			 * client must reconnect in time for the settings to be saved */
+			double rollback_ms = json_object_get_number(
+					json_value_get_object(pars), "rollback_ms");
+			if (!(rollback_ms >= 0
+					&& rollback_ms <= NET_RECONFIG_MAX_ROLLBACK_MS)) {
+				lDebug(Warn, "Invalid rollback_ms");
+				ack = false;
+			} else {
+				ack = net_reconfig_start(settings, (uint32_t) rollback_ms);
+			}
 		}
 
 		JSON_Value *ans = json_value_init_object();
-		json_object_set_boolean(json_value_get_object(ans), "ACK", true);
+		json_object_set_boolean(json_value_get_object(ans), "ACK", ack);
 		return ans;
 	}
 	return NULL;
 }
 
+#if (configUSE_MALLOC_DEBUG == 1)
+#define MEM_INFO_MAX_OWNERS		16
+
+/**
+ * @brief 	builds the heap usage breakdown by task. Owners are matched against
+ * 			the running tasks, since the blocks of a deleted task keep
+ * 			pointing to its freed TCB.
+ * @returns	JSON object with the bytes and blocks of every owner
+ */
+static JSON_Value* mem_owners_json(void)
+{
+	HeapOwnerStats_t owners[MEM_INFO_MAX_OWNERS];
+	UBaseType_t n_owners = uxPortGetHeapOwnerStats(owners, MEM_INFO_MAX_OWNERS);
+	JSON_Value *ans = json_value_init_object();
+
+	UBaseType_t n_tasks = uxTaskGetNumberOfTasks();
+	TaskStatus_t *tasks = pvPortMalloc(n_tasks * sizeof(TaskStatus_t));
+	if (tasks) {
+		n_tasks = uxTaskGetSystemState(tasks, n_tasks, NULL);
+	} else {
+		n_tasks = 0;
+	}
+
+	for (UBaseType_t i = 0; (i < n_owners) && (i < MEM_INFO_MAX_OWNERS); i++) {
+		char const *name = owners[i].pvOwner ? "(deleted)" : "(boot)";
+		for (UBaseType_t t = 0; t < n_tasks; t++) {
+			if (tasks[t].xHandle == owners[i].pvOwner) {
+				name = tasks[t].pcTaskName;
+				break;
+			}
+		}
+
+		/* Blocks of deleted tasks are merged under the same name */
+		JSON_Object *owner = json_object_get_object(json_value_get_object(ans),
+				name);
+		if (!owner) {
+			json_object_set_value(json_value_get_object(ans), name,
+					json_value_init_object());
+			owner = json_object_get_object(json_value_get_object(ans), name);
+		}
+		json_object_set_number(owner, "BYTES",
+				json_object_get_number(owner, "BYTES") + owners[i].xBytes);
+		json_object_set_number(owner, "BLOCKS",
+				json_object_get_number(owner, "BLOCKS") + owners[i].xBlocks);
+	}
+	vPortFree(tasks);
+
+	if (n_owners > MEM_INFO_MAX_OWNERS) {
+		json_object_set_boolean(json_value_get_object(ans), "TRUNCATED", true);
+	}
+	return ans;
+}
+#endif
+
 JSON_Value* mem_info_cmd(JSON_Value const *pars)
 {
 	JSON_Value *ans = json_value_init_object();
@@ -263,9 +516,254 @@ JSON_Value* mem_info_cmd(JSON_Value const *pars)
 			xPortGetFreeHeapSize());
 	json_object_set_number(json_value_get_object(ans), "MEM_MIN_FREE",
 			xPortGetMinimumEverFreeHeapSize());
+
+	struct json_arena_stats arena;
+	json_arena_get_stats(&arena);
+	JSON_Object *obj = json_value_get_object(ans);
+	json_object_dotset_number(obj, "JSON_ARENA.SIZE", JSON_ARENA_SIZE);
+	json_object_dotset_number(obj, "JSON_ARENA.HIGH_WATER", arena.high_water);
+	json_object_dotset_number(obj, "JSON_ARENA.REQUESTS", arena.requests);
+	json_object_dotset_number(obj, "JSON_ARENA.FALLBACK_CHUNKS",
+			arena.fallback_chunks);
+	json_object_dotset_number(obj, "JSON_ARENA.HEAP_ALLOCS", arena.heap_allocs);
+
+	struct block_pool_stats pools[BLOCK_POOL_CLASSES];
+	block_pool_get_stats(pools);
+	JSON_Value *pools_array = json_value_init_array();
+	for (int i = 0; i < BLOCK_POOL_CLASSES; i++) {
+		JSON_Value *pool = json_value_init_object();
+		JSON_Object *pool_obj = json_value_get_object(pool);
+		json_object_set_number(pool_obj, "BLOCK_SIZE", pools[i].block_size);
+		json_object_set_number(pool_obj, "BLOCKS", pools[i].blocks);
+		json_object_set_number(pool_obj, "IN_USE", pools[i].in_use);
+		json_object_set_number(pool_obj, "HIGH_WATER", pools[i].high_water);
+		json_object_set_number(pool_obj, "ALLOCS", pools[i].allocs);
+		json_object_set_number(pool_obj, "OVERFLOWS", pools[i].overflows);
+		json_array_append_value(json_value_get_array(pools_array), pool);
+	}
+	json_object_dotset_value(obj, "BLOCK_POOL.CLASSES", pools_array);
+	json_object_dotset_number(obj, "BLOCK_POOL.HEAP_ALLOCS",
+			block_pool_heap_allocs());
+
+	HeapFragmentationStats_t frag;
+	vPortGetHeapFragmentationStats(&frag);
+	json_object_set_number(obj, "MEM_LARGEST_FREE", frag.xLargestFreeBlock);
+	json_object_set_number(obj, "MEM_SMALLEST_FREE", frag.xSmallestFreeBlock);
+	json_object_set_number(obj, "MEM_FREE_BLOCKS", frag.xFreeBlocks);
+	json_object_set_number(obj, "MEM_ALLOCS", frag.ulAllocations);
+	json_object_set_number(obj, "MEM_FREES", frag.ulFrees);
+	json_object_set_number(obj, "MEM_FAILED_ALLOCS", frag.ulFailedAllocations);
+
+	/* Buckets are keyed by the smallest block size they count */
+	JSON_Value *histogram = json_value_init_object();
+	for (int i = 0; i < portHEAP_HISTOGRAM_BUCKETS; i++) {
+		char key[8];
+		snprintf(key, sizeof(key), "%u", i ? (16u << i) : 0u);
+		json_object_set_number(json_value_get_object(histogram), key,
+				frag.xHistogram[i]);
+	}
+	json_object_set_value(obj, "MEM_HISTOGRAM", histogram);
+
+#if (configUSE_MALLOC_DEBUG == 1)
+	json_object_set_value(obj, "MEM_OWNERS", mem_owners_json());
+#endif
+	return ans;
+}
+
+JSON_Value* mem_scan_cmd(JSON_Value const *pars)
+{
+	return mem_check_json();
+}
+
+JSON_Value* isr_stats_cmd(JSON_Value const *pars)
+{
+	JSON_Value *ans = isr_stats_json();
+
+	if (pars && json_value_get_type(pars) == JSONObject
+			&& json_object_get_boolean(json_value_get_object(pars), "reset")
+					== 1) {
+		isr_stats_reset();
+	}
 	return ans;
 }
 
+#if LWIP_STATS
+/* Names of the memp pools, in the order of memp_t */
+static const char *const memp_names[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name,num,size,desc) desc,
+#include "lwip/memp_std.h"
+};
+
+static JSON_Value* net_stats_mem_json(struct stats_mem const *mem)
+{
+	JSON_Value *ans = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(ans);
+	json_object_set_number(obj, "AVAIL", mem->avail);
+	json_object_set_number(obj, "USED", mem->used);
+	json_object_set_number(obj, "MAX", mem->max);
+	json_object_set_number(obj, "ERR", mem->err);
+	return ans;
+}
+
+JSON_Value* net_stats_cmd(JSON_Value const *pars)
+{
+	SYS_ARCH_DECL_PROTECT(lev);
+	struct stats_ stats;
+
+	/* Take a consistent snapshot, the counters are updated by the stack */
+	SYS_ARCH_PROTECT(lev);
+	stats = lwip_stats;
+	SYS_ARCH_UNPROTECT(lev);
+
+	JSON_Value *ans = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(ans);
+
+	JSON_Value *pools = json_value_init_object();
+	for (int i = 0; i < MEMP_MAX; i++) {
+		json_object_set_value(json_value_get_object(pools), memp_names[i],
+				net_stats_mem_json(&stats.memp[i]));
+	}
+	json_object_set_value(obj, "MEMP", pools);
+	json_object_set_value(obj, "HEAP", net_stats_mem_json(&stats.mem));
+
+	json_object_dotset_number(obj, "LINK.XMIT", stats.link.xmit);
+	json_object_dotset_number(obj, "LINK.RECV", stats.link.recv);
+	json_object_dotset_number(obj, "LINK.DROP", stats.link.drop);
+	json_object_dotset_number(obj, "LINK.CHKERR", stats.link.chkerr);
+	json_object_dotset_number(obj, "LINK.LENERR", stats.link.lenerr);
+	json_object_dotset_number(obj, "LINK.MEMERR", stats.link.memerr);
+	json_object_dotset_number(obj, "LINK.ERR", stats.link.err);
+
+	/* Receive counters of the EMAC buffer ring, the client derives the
+	 * throughput from two readings and their ticks */
+	struct lpc_rx_stats rx;
+	lpc_rx_get_stats(&rx);
+	json_object_dotset_number(obj, "RX.FRAMES", rx.frames);
+	json_object_dotset_number(obj, "RX.BYTES", rx.bytes);
+	json_object_dotset_number(obj, "RX.POOL_SIZE", rx.pool_size);
+	json_object_dotset_number(obj, "RX.POOL_FREE", rx.pool_free);
+	json_object_dotset_number(obj, "RX.POOL_FREE_MIN", rx.pool_free_min);
+	json_object_dotset_number(obj, "RX.STARVED", rx.starved);
+	json_object_dotset_number(obj, "RX.CSUM_SW", rx.csum_sw);
+	json_object_dotset_number(obj, "RX.WAKEUPS", rx.wakeups);
+	json_object_dotset_number(obj, "RX.BATCH_MAX", rx.batch_max);
+	json_object_dotset_number(obj, "RX.FRAMES_PER_WAKEUP",
+			rx.wakeups ? (double) rx.frames / rx.wakeups : 0);
+
+	struct lpc_tx_stats tx;
+	lpc_tx_get_stats(&tx);
+	json_object_dotset_number(obj, "TX.STALLS", tx.stalls);
+	json_object_dotset_number(obj, "TX.TIMEOUTS", tx.timeouts);
+	json_object_dotset_number(obj, "TX.WAIT_US", tx.wait_us);
+	json_object_dotset_number(obj, "TX.WAIT_MAX_US", tx.wait_max_us);
+	json_object_set_value(obj, "SERVER", tcp_server_stats_json());
+	json_object_set_number(obj, "TICK", xTaskGetTickCount());
+	return ans;
+}
+#endif
+
+/* Iterations of every SYS_BENCH measurement */
+#define SYS_BENCH_DEFAULT_COUNT		100
+#define SYS_BENCH_MAX_COUNT			1000
+
+/**
+ * @struct 	sys_bench
+ * @brief	DWT cycles of the iterations of a measurement.
+ */
+struct sys_bench {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+};
+
+static void sys_bench_add(struct sys_bench *b, uint32_t cycles)
+{
+	b->count++;
+	b->total += cycles;
+	if (cycles > b->max) {
+		b->max = cycles;
+	}
+	if (!b->min || (cycles < b->min)) {
+		b->min = cycles;
+	}
+}
+
+static JSON_Value* sys_bench_json(struct sys_bench const *b)
+{
+	double cycles_per_us = SystemCoreClock / 1000000;
+
+	JSON_Value *ans = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(ans);
+	json_object_set_number(obj, "COUNT", b->count);
+	json_object_set_number(obj, "MIN_US", b->min / cycles_per_us);
+	json_object_set_number(obj, "MAX_US", b->max / cycles_per_us);
+	json_object_set_number(obj, "AVG_US",
+			b->count ? (b->total / cycles_per_us) / b->count : 0);
+	return ans;
+}
+
+/**
+ * @brief 	measures the lwIP semaphores and a socket call, to compare the
+ * 			sys_arch backends selected with SYS_ARCH_SEM_NOTIFY.
+ * @param 	*pars 	:optional "count" of iterations
+ * @returns	JSON object with the minimum, maximum and average latencies
+ */
+JSON_Value* sys_bench_cmd(JSON_Value const *pars)
+{
+	int count = SYS_BENCH_DEFAULT_COUNT;
+
+	if (pars && json_value_get_type(pars) == JSONObject) {
+		int n = json_object_get_number(json_value_get_object(pars), "count");
+		if (n > 0) {
+			count = (n < SYS_BENCH_MAX_COUNT) ? n : SYS_BENCH_MAX_COUNT;
+		}
+	}
+
+	JSON_Value *ans = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(ans);
+	json_object_set_string(obj, "SEM", SYS_ARCH_SEM_NOTIFY ? "NOTIFY" : "QUEUE");
+
+	/* Uncontended signal and wait, the cost of the primitive itself */
+	sys_sem_t sem;
+	if (sys_sem_new(&sem, 0) == ERR_OK) {
+		struct sys_bench b = { 0 };
+		for (int i = 0; i < count; i++) {
+			uint32_t start = DWT->CYCCNT;
+			sys_sem_signal(&sem);
+			sys_arch_sem_wait(&sem, 0);
+			sys_bench_add(&b, DWT->CYCCNT - start);
+		}
+		sys_sem_free(&sem);
+		json_object_set_value(obj, "SEM_SIGNAL_WAIT", sys_bench_json(&b));
+	}
+
+	/* getsockopt() is a round trip to the tcpip thread, a post to its
+	 * mailbox and a wait on the netconn semaphore, as every socket call */
+	int sock = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		lDebug(Error, "Unable to create socket: errno %d", errno);
+		return ans;
+	}
+
+	struct sys_bench b = { 0 };
+	for (int i = 0; i < count; i++) {
+		int type;
+		socklen_t len = sizeof(type);
+		uint32_t start = DWT->CYCCNT;
+		lwip_getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &len);
+		sys_bench_add(&b, DWT->CYCCNT - start);
+	}
+	lwip_close(sock);
+	json_object_set_value(obj, "GETSOCKOPT", sys_bench_json(&b));
+	return ans;
+}
+
+JSON_Value* link_info_cmd(JSON_Value const *pars)
+{
+	return link_monitor_json();
+}
+
 JSON_Value* temperature_info_cmd(JSON_Value const *pars)
 {
 	JSON_Value *ans = json_value_init_object();
@@ -286,6 +784,7 @@ const cmd_entry cmds_table[] = {
 		{
 				"CONTROL_ENABLE",
 				control_enable_cmd,
+				true,					/* May block, see cmd_may_block() */
 		},
 		{
 				"STALL_CONTROL",
@@ -294,35 +793,80 @@ const cmd_entry cmds_table[] = {
 		{
 				"AXIS_STOP",
 				axis_stop_cmd,
+				true,
 		},
 		{
 				"AXIS_FREE_RUN",
 				axis_free_run_cmd,
+				true,
 		},
 		{
 				"AXIS_FREE_RUN_STEPS",
 				axis_free_run_steps_cmd,
+				true,
 		},
 		{
 				"AXIS_CLOSED_LOOP",
 				axis_closed_loop_cmd,
+				true,
 		},
 		{
 				"TELEMETRIA",
 				telemetria_cmd,
 		},
+		{
+				"SUBSCRIBE",
+				subscribe_cmd,
+		},
+		{
+				"UNSUBSCRIBE",
+				unsubscribe_cmd,
+		},
+		{
+				"TELEMETRY_UDP",
+				telemetry_udp_cmd,
+				true,
+		},
 		{
 				"LOGS",
 				logs_cmd,
 		},
+		{
+				"LOG_LEVEL",
+				log_level_cmd,
+		},
 		{
 				"NETWORK_SETTINGS",
 				network_settings_cmd,
+				true,
 		},
 		{
 				"MEM_INFO",
 				mem_info_cmd,
 		},
+		{
+				"MEM_SCAN",
+				mem_scan_cmd,
+		},
+		{
+				"ISR_STATS",
+				isr_stats_cmd,
+		},
+		{
+				"SYS_BENCH",
+				sys_bench_cmd,
+				true,
+		},
+		{
+				"LINK_INFO",
+				link_info_cmd,
+		},
+#if LWIP_STATS
+		{
+				"NET_STATS",
+				net_stats_cmd,
+		},
+#endif
 		{
 				"TEMPERATURE_INFO",
 				temperature_info_cmd,
@@ -330,13 +874,39 @@ const cmd_entry cmds_table[] = {
 };
 // @formatter:on
 
+/**
+ * @brief 	returns if a command can block its caller, moving the axes or
+ * 			writing the settings. Servers running inside the tcpip thread
+ * 			hand these to cmd_sched instead of executing them.
+ * @param 	*cmd 	:name of the command
+ * @returns	false for unknown commands, cmd_execute() only logs them
+ */
+bool cmd_may_block(char const *cmd)
+{
+	for (int i = 0; i < (sizeof(cmds_table) / sizeof(cmds_table[0])); i++) {
+		if (!strcmp(cmd, cmds_table[i].cmd_name)) {
+			return cmds_table[i].may_block;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief 	creates the mutex serializing the command execution.
+ * @returns	nothing
+ * @note	call before the tasks executing commands are started.
+ */
+void net_commands_init(void)
+{
+	cmd_mutex = rtos_mutex_create(RTOS_BANK_RAMLOC32);
+}
+
 /**
  * @brief 	searchs for a matching command name in cmds_table[], passing the parameters
  * 			as a JSON object for the called function to parse them.
- * @param 	*cmd 	:name of the command to execute
- * @param   *pars   :JSON object containing the passed parameters to the called function
+ * @note	must be called with cmd_mutex taken.
  */
-JSON_Value* cmd_execute(char const *cmd, JSON_Value const *pars)
+static JSON_Value* cmd_execute_locked(char const *cmd, JSON_Value const *pars)
 {
 	bool cmd_found = false;
 	for (int i = 0; i < (sizeof(cmds_table) / sizeof(cmds_table[0])); i++) {
@@ -349,3 +919,51 @@ JSON_Value* cmd_execute(char const *cmd, JSON_Value const *pars)
 	}
 	return NULL;
 }
+
+/**
+ * @brief 	executes a command, waiting for the one in progress to finish.
+ * @param 	*cmd 	:name of the command to execute
+ * @param   *pars   :JSON object containing the passed parameters to the called function
+ * @returns	the answer of the command, NULL if none. Caller must free it
+ */
+JSON_Value* cmd_execute(char const *cmd, JSON_Value const *pars)
+{
+	xSemaphoreTake(cmd_mutex, portMAX_DELAY);
+	JSON_Value *ans = cmd_execute_locked(cmd, pars);
+	xSemaphoreGive(cmd_mutex);
+	return ans;
+}
+
+/**
+ * @brief 	same as cmd_execute(), also telling when the command started.
+ * @param   *tick   :set to the tick the command started at, after waiting
+ * 					 for the one in progress
+ */
+JSON_Value* cmd_execute_tick(char const *cmd, JSON_Value const *pars,
+		TickType_t *tick)
+{
+	xSemaphoreTake(cmd_mutex, portMAX_DELAY);
+	*tick = xTaskGetTickCount();
+	JSON_Value *ans = cmd_execute_locked(cmd, pars);
+	xSemaphoreGive(cmd_mutex);
+	return ans;
+}
+
+/**
+ * @brief 	executes a command unless another one is in progress.
+ * @param 	*cmd 	:name of the command to execute
+ * @param   *pars   :JSON object containing the passed parameters to the called function
+ * @param   **ans   :set to the answer of the command, caller must free it
+ * @returns	false if another command is in progress, nothing was executed
+ * @note	for the tcpip thread, which can't wait for a command that may be
+ * 			waiting for it.
+ */
+bool cmd_try_execute(char const *cmd, JSON_Value const *pars, JSON_Value **ans)
+{
+	if (xSemaphoreTake(cmd_mutex, 0) != pdTRUE) {
+		return false;
+	}
+	*ans = cmd_execute_locked(cmd, pars);
+	xSemaphoreGive(cmd_mutex);
+	return true;
+}
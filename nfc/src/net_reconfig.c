@@ -0,0 +1,261 @@
+#include "net_reconfig.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+#include "lwip/tcpip.h"
+#include "lwip/netif.h"
+#include "lwip/tcp_impl.h"
+#include "settings.h"
+#include "tcp_server.h"
+#include "tcp_server_raw.h"
+#include "log_server.h"
+#include "debug.h"
+#include "rtos_static.h"
+#include "cmd_sched.h"
+
+/**
+ * @brief Applies new network settings without a reset. The address goes to
+ * the interface with netif_set_addr() and the command and log servers are
+ * moved to the new ports. With a rollback timeout the settings are only saved once a
+ * client reconnects, otherwise the previous ones are restored.
+ */
+
+enum net_reconfig_state {
+	NET_RECONFIG_IDLE,
+	NET_RECONFIG_APPLYING,		/* Waiting to hand the new settings to lwIP */
+	NET_RECONFIG_TRIAL,			/* Waiting for a client to reconnect */
+	NET_RECONFIG_SAVING,		/* Waiting for cmd_sched to save the settings */
+	NET_RECONFIG_ROLLING_BACK,	/* Waiting to hand the previous settings to lwIP */
+};
+
+/**
+ * @struct 	net_reconfig
+ * @brief	state of the reconfiguration. Driven by a one shot timer, the
+ * 			settings are applied from the tcpip thread.
+ */
+struct net_reconfig {
+	TimerHandle_t timer;
+	enum net_reconfig_state state;
+	struct settings pending;	/* Settings being applied */
+	struct settings previous;	/* Restored by the rollback */
+	uint32_t rollback_ms;		/* 0 if the settings are saved right away */
+	uint16_t port;				/* Port of the command server, tcpip thread only */
+	volatile bool connected;	/* A client connected since the last apply */
+};
+
+static struct net_reconfig reconfig;
+
+/**
+ * @brief 	saves the network part of the settings, keeping the rest as
+ * 			currently stored.
+ */
+static void net_reconfig_save(struct settings const *settings)
+{
+	struct settings stored = settings_read();
+
+	stored.ipaddr = settings->ipaddr;
+	stored.netmask = settings->netmask;
+	stored.gw = settings->gw;
+	stored.port = settings->port;
+	settings_save(stored);
+}
+
+/**
+ * @brief 	saves the settings confirmed by a reconnected client.
+ * @note	runs in the cmd_sched task, see net_reconfig_timer().
+ */
+static void net_reconfig_save_pending(void *arg)
+{
+	net_reconfig_save(&reconfig.pending);
+	reconfig.state = NET_RECONFIG_IDLE;
+}
+
+/**
+ * @brief 	aborts the connections to a local port. netif_set_addr() only
+ * 			drops the connections when the address changes.
+ * @note	runs in the tcpip thread.
+ */
+static void net_reconfig_abort_port(uint16_t port)
+{
+	struct tcp_pcb *pcb = tcp_active_pcbs;
+
+	while (pcb != NULL) {
+		if (pcb->local_port == port) {
+			struct tcp_pcb *next = pcb->next;
+			tcp_abort(pcb);
+			pcb = next;
+		} else {
+			pcb = pcb->next;
+		}
+	}
+}
+
+/**
+ * @brief 	hands the settings to the interface and the command server.
+ * @note	runs in the tcpip thread.
+ */
+static void net_reconfig_apply(void *arg)
+{
+	struct settings *settings = arg;
+	char addr_str[16];
+
+	netif_set_addr(netif_default, &settings->ipaddr, &settings->netmask,
+			&settings->gw);
+
+	if (settings->port != reconfig.port) {
+		net_reconfig_abort_port(reconfig.port);
+		net_reconfig_abort_port(reconfig.port + LOG_SERVER_PORT_OFFSET);
+#if TCP_SERVER_RAW
+		tcp_server_raw_restart(settings->port);
+#else
+		tcp_server_restart(settings->port);
+#endif
+		/* The log server follows the command port, as it does at boot */
+		log_server_restart(settings->port + LOG_SERVER_PORT_OFFSET);
+		reconfig.port = settings->port;
+	}
+
+	reconfig.connected = false;
+	if (reconfig.state != NET_RECONFIG_TRIAL) {
+		reconfig.state = NET_RECONFIG_IDLE;
+	}
+
+	lDebug(Info, "Network settings applied: ipaddr:%s, port:%d",
+			ipaddr_ntoa_r(&settings->ipaddr, addr_str, sizeof(addr_str)),
+			settings->port);
+}
+
+/**
+ * @brief 	posts net_reconfig_apply() to the tcpip thread.
+ * @returns	false if the mailbox was full, the timer is set to retry
+ * @note	runs in the timer task, which can't wait for the mailbox.
+ */
+static bool net_reconfig_post(struct settings *settings)
+{
+	if (tcpip_callback_with_block(net_reconfig_apply, settings, 0) != ERR_OK) {
+		xTimerChangePeriod(reconfig.timer, pdMS_TO_TICKS(NET_RECONFIG_RETRY_MS),
+				0);
+		return false;
+	}
+	return true;
+}
+
+static void net_reconfig_timer(TimerHandle_t timer)
+{
+	switch (reconfig.state) {
+	case NET_RECONFIG_APPLYING:
+		/* Switch to TRIAL before the apply runs, so it doesn't go IDLE */
+		if (reconfig.rollback_ms) {
+			reconfig.state = NET_RECONFIG_TRIAL;
+		}
+		if (!net_reconfig_post(&reconfig.pending)) {
+			reconfig.state = NET_RECONFIG_APPLYING;
+			break;
+		}
+		if (reconfig.rollback_ms) {
+			xTimerChangePeriod(timer, pdMS_TO_TICKS(reconfig.rollback_ms), 0);
+		}
+		break;
+
+	case NET_RECONFIG_TRIAL:
+		if (reconfig.connected) {
+			/* Writing the EEPROM here would stall the timer task, and the
+			 * link monitor with it */
+			if (!cmd_sched_defer(net_reconfig_save_pending, NULL)) {
+				xTimerChangePeriod(timer, pdMS_TO_TICKS(NET_RECONFIG_RETRY_MS),
+						0);
+				break;
+			}
+			lDebug(Info, "Client reconnected, saving the network settings");
+			reconfig.state = NET_RECONFIG_SAVING;
+			break;
+		}
+		lDebug(Warn, "No client reconnected, restoring the network settings");
+		reconfig.state = NET_RECONFIG_ROLLING_BACK;
+		/* no break */
+
+	case NET_RECONFIG_ROLLING_BACK:
+		net_reconfig_post(&reconfig.previous);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief 	creates the timer driving the reconfigurations.
+ * @param 	port	:port the command server was started on
+ * @returns	nothing
+ */
+void net_reconfig_init(uint16_t port)
+{
+	reconfig.port = port;
+	reconfig.timer = rtos_timer_create("NetReconf",
+			pdMS_TO_TICKS(NET_RECONFIG_APPLY_DELAY_MS), pdFALSE,
+			net_reconfig_timer, RTOS_BANK_RAMLOC32);
+	if (!reconfig.timer) {
+		lDebug(Error, "Unable to create the reconfiguration timer");
+	}
+}
+
+/**
+ * @brief 	applies new network settings once the response to the current
+ * 			request has been sent.
+ * @param 	settings	:settings to apply, only the address, netmask,
+ * 						 gateway and port are used
+ * @param 	rollback_ms	:time for a client to reconnect before the previous
+ * 						 settings are restored, 0 saves them right away
+ * @returns	false if a reconfiguration is already in progress
+ * @note	the connections to the command server are dropped when the
+ * 			address or the port change.
+ */
+bool net_reconfig_start(struct settings settings, uint32_t rollback_ms)
+{
+	struct settings current = settings_read();
+
+	/* Nothing will be dropped, so no client would have to reconnect */
+	if (ip_addr_cmp(&settings.ipaddr, &current.ipaddr)
+			&& (settings.port == current.port)) {
+		rollback_ms = 0;
+	}
+
+	taskENTER_CRITICAL();
+	bool idle = reconfig.timer && (reconfig.state == NET_RECONFIG_IDLE);
+	if (idle) {
+		reconfig.state = NET_RECONFIG_APPLYING;
+	}
+	taskEXIT_CRITICAL();
+
+	if (!idle) {
+		lDebug(Error, "Network reconfiguration in progress");
+		return false;
+	}
+
+	reconfig.pending = settings;
+	reconfig.previous = current;
+	reconfig.rollback_ms = rollback_ms;
+
+	if (!rollback_ms) {
+		net_reconfig_save(&settings);
+	}
+
+	xTimerChangePeriod(reconfig.timer,
+			pdMS_TO_TICKS(NET_RECONFIG_APPLY_DELAY_MS), portMAX_DELAY);
+	return true;
+}
+
+/**
+ * @brief 	tells a client connected to the command server, confirming the
+ * 			settings being tried.
+ * @returns	nothing
+ */
+void net_reconfig_client_connected(void)
+{
+	reconfig.connected = true;
+}
@@ -0,0 +1,277 @@
+#include "rtos_static.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "timers.h"
+
+#include "debug.h"
+#include "mem_sections.h"
+
+/**
+ * @struct 	rtos_bank_info
+ * @brief	address range of a RAM bank and its static pool.
+ */
+struct rtos_bank_info {
+	const char *name;
+	uint32_t start;
+	uint32_t end;
+	uint8_t *pool;
+	size_t size;
+	size_t used;
+	uint32_t fallbacks;			/* Objects that didn't fit and went to the heap */
+};
+
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+static uint8_t BSS_RAMLOC32 __attribute__((aligned(portBYTE_ALIGNMENT))) pool_ramloc32[RTOS_RAMLOC32_POOL_SIZE];
+static uint8_t BSS_RAMLOC40 __attribute__((aligned(portBYTE_ALIGNMENT))) pool_ramloc40[RTOS_RAMLOC40_POOL_SIZE];
+static uint8_t BSS_RAMAHB __attribute__((aligned(portBYTE_ALIGNMENT))) pool_ramahb[RTOS_RAMAHB_POOL_SIZE];
+
+#define RTOS_POOL(p)	p, sizeof(p)
+#else
+#define RTOS_POOL(p)	NULL, 0
+#endif
+
+// @formatter:off
+static struct rtos_bank_info banks[RTOS_BANKS] = {
+		[RTOS_BANK_RAMLOC32] = { "RamLoc32", 0x10000000, 0x10008000, RTOS_POOL(pool_ramloc32) },
+		[RTOS_BANK_RAMLOC40] = { "RamLoc40", 0x10080000, 0x1008A000, RTOS_POOL(pool_ramloc40) },
+		[RTOS_BANK_RAMAHB]   = { "RamAHB",   0x20000000, 0x20010000, RTOS_POOL(pool_ramahb) },
+};
+// @formatter:on
+
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+/**
+ * @brief 	takes memory from the pool of a bank. Objects are never deleted, so
+ * 			the pools are only bumped.
+ * @param 	bank	: bank to allocate from
+ * @param 	size	: bytes to allocate
+ * @returns	NULL if the pool is exhausted
+ */
+static void* rtos_static_alloc(enum rtos_bank bank, size_t size)
+{
+	struct rtos_bank_info *b = &banks[bank];
+	void *ptr = NULL;
+
+	size = (size + portBYTE_ALIGNMENT_MASK) & ~portBYTE_ALIGNMENT_MASK;
+
+	taskENTER_CRITICAL();
+	if (b->used + size <= b->size) {
+		ptr = b->pool + b->used;
+		b->used += size;
+	} else {
+		b->fallbacks++;
+	}
+	taskEXIT_CRITICAL();
+	return ptr;
+}
+#endif
+
+/**
+ * @brief 	creates a task that lives until the next reset. With
+ * 			configSUPPORT_STATIC_ALLOCATION its stack and TCB are taken from
+ * 			the pool of the requested bank, otherwise from the heap.
+ * @param 	function	: task entry point
+ * @param 	name		: task name
+ * @param 	stack_words	: stack depth in words
+ * @param 	par			: parameter passed to the task
+ * @param 	priority	: task priority
+ * @param 	bank		: RAM bank for the stack and TCB
+ * @returns	the task handle, NULL if there was no memory for it
+ */
+TaskHandle_t rtos_task_create(TaskFunction_t function, const char *name,
+		uint16_t stack_words, void *par, UBaseType_t priority,
+		enum rtos_bank bank)
+{
+	TaskHandle_t handle = NULL;
+
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+	StaticTask_t *tcb = rtos_static_alloc(bank, sizeof(StaticTask_t));
+	StackType_t *stack =
+			tcb ? rtos_static_alloc(bank, stack_words * sizeof(StackType_t)) : NULL;
+	if (tcb && stack) {
+		return xTaskCreateStatic(function, name, stack_words, par, priority,
+				stack, tcb);
+	}
+	lDebug(Warn, "%s doesn't fit in %s, using the heap", name,
+			banks[bank].name);
+#endif
+
+	if (xTaskCreate(function, name, stack_words, par, priority, &handle)
+			!= pdPASS) {
+		lDebug(Error, "Unable to create task %s", name);
+		return NULL;
+	}
+	return handle;
+}
+
+/**
+ * @brief 	creates a queue that lives until the next reset.
+ * @param 	length		: maximum number of items
+ * @param 	item_size	: size of every item in bytes
+ * @param 	bank		: RAM bank for the queue and its storage
+ * @returns	the queue handle, NULL if there was no memory for it
+ */
+QueueHandle_t rtos_queue_create(UBaseType_t length, UBaseType_t item_size,
+		enum rtos_bank bank)
+{
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+	StaticQueue_t *queue = rtos_static_alloc(bank, sizeof(StaticQueue_t));
+	uint8_t *storage =
+			queue ? rtos_static_alloc(bank, length * item_size) : NULL;
+	if (queue && (storage || !(length * item_size))) {
+		return xQueueCreateStatic(length, item_size, storage, queue);
+	}
+#endif
+	return xQueueCreate(length, item_size);
+}
+
+/**
+ * @brief 	creates a mutex that lives until the next reset.
+ * @param 	bank		: RAM bank for the mutex
+ * @returns	the mutex handle, NULL if there was no memory for it
+ */
+SemaphoreHandle_t rtos_mutex_create(enum rtos_bank bank)
+{
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+	StaticSemaphore_t *mutex = rtos_static_alloc(bank, sizeof(StaticSemaphore_t));
+	if (mutex) {
+		return xSemaphoreCreateMutexStatic(mutex);
+	}
+#endif
+	return xSemaphoreCreateMutex();
+}
+
+/**
+ * @brief 	creates a counting semaphore that lives until the next reset.
+ * @param 	max			: maximum count
+ * @param 	initial		: initial count
+ * @param 	bank		: RAM bank for the semaphore
+ * @returns	the semaphore handle, NULL if there was no memory for it
+ */
+SemaphoreHandle_t rtos_semaphore_create_counting(UBaseType_t max,
+		UBaseType_t initial, enum rtos_bank bank)
+{
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+	StaticSemaphore_t *sem = rtos_static_alloc(bank, sizeof(StaticSemaphore_t));
+	if (sem) {
+		return xSemaphoreCreateCountingStatic(max, initial, sem);
+	}
+#endif
+	return xSemaphoreCreateCounting(max, initial);
+}
+
+/**
+ * @brief 	creates a software timer that lives until the next reset. It is
+ * 			created dormant, start it with xTimerStart().
+ * @param 	name		: timer name
+ * @param 	period		: period in ticks
+ * @param 	auto_reload	: pdTRUE for a periodic timer
+ * @param 	callback	: function run by the timer task when it expires
+ * @param 	bank		: RAM bank for the timer
+ * @returns	the timer handle, NULL if there was no memory for it
+ */
+TimerHandle_t rtos_timer_create(const char *name, TickType_t period,
+		UBaseType_t auto_reload, TimerCallbackFunction_t callback,
+		enum rtos_bank bank)
+{
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+	StaticTimer_t *timer = rtos_static_alloc(bank, sizeof(StaticTimer_t));
+	if (timer) {
+		return xTimerCreateStatic(name, period, auto_reload, NULL, callback,
+				timer);
+	}
+#endif
+	return xTimerCreate(name, period, auto_reload, NULL, callback);
+}
+
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+/**
+ * @brief 	provides the idle task memory, required by static allocation.
+ */
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer,
+		StackType_t **ppxIdleTaskStackBuffer, uint32_t *pulIdleTaskStackSize)
+{
+	static StaticTask_t idle_tcb;
+	static StackType_t idle_stack[configMINIMAL_STACK_SIZE];
+
+	*ppxIdleTaskTCBBuffer = &idle_tcb;
+	*ppxIdleTaskStackBuffer = idle_stack;
+	*pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+/**
+ * @brief 	provides the timer task memory, required by static allocation.
+ */
+void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer,
+		StackType_t **ppxTimerTaskStackBuffer, uint32_t *pulTimerTaskStackSize)
+{
+	static StaticTask_t timer_tcb;
+	static StackType_t timer_stack[configTIMER_TASK_STACK_DEPTH];
+
+	*ppxTimerTaskTCBBuffer = &timer_tcb;
+	*ppxTimerTaskStackBuffer = timer_stack;
+	*pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
+}
+#endif
+
+/**
+ * @brief 	returns the name of the bank holding an address.
+ */
+static const char* rtos_bank_name(const void *ptr)
+{
+	uint32_t addr = (uint32_t) ptr;
+
+	for (int i = 0; i < RTOS_BANKS; i++) {
+		if ((addr >= banks[i].start) && (addr < banks[i].end)) {
+			return banks[i].name;
+		}
+	}
+	return "?";
+}
+
+/**
+ * @brief 	prints where the stack and TCB of every task ended up, and the
+ * 			usage of the static pools.
+ * @returns	nothing
+ * @note	printed directly to the console, the report is longer than the
+ * 			deferred log ring.
+ */
+void rtos_memory_map_report(void)
+{
+	UBaseType_t n_tasks = uxTaskGetNumberOfTasks();
+	TaskStatus_t *tasks = pvPortMalloc(n_tasks * sizeof(TaskStatus_t));
+
+	if (!tasks) {
+		lDebug(Error, "Out Of Memory");
+		return;
+	}
+	n_tasks = uxTaskGetSystemState(tasks, n_tasks, NULL);
+
+	printf("Memory map (%s allocation):\n",
+			configSUPPORT_STATIC_ALLOCATION ? "static" : "dynamic");
+	printf("%-*s %-10s %-8s %-10s %-8s %s\n", configMAX_TASK_NAME_LEN, "TASK",
+			"TCB", "BANK", "STACK", "BANK", "FREE");
+	for (UBaseType_t i = 0; i < n_tasks; i++) {
+		printf("%-*s 0x%08lx %-8s 0x%08lx %-8s %u\n", configMAX_TASK_NAME_LEN,
+				tasks[i].pcTaskName, (uint32_t) tasks[i].xHandle,
+				rtos_bank_name(tasks[i].xHandle),
+				(uint32_t) tasks[i].pxStackBase,
+				rtos_bank_name(tasks[i].pxStackBase),
+				(unsigned) (tasks[i].usStackHighWaterMark * sizeof(StackType_t)));
+	}
+	vPortFree(tasks);
+
+	for (int i = 0; i < RTOS_BANKS; i++) {
+		if (banks[i].size) {
+			printf("%s pool: %u of %u bytes used, %lu objects in the heap\n",
+					banks[i].name, (unsigned) banks[i].used,
+					(unsigned) banks[i].size, banks[i].fallbacks);
+		}
+	}
+}
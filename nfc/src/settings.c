@@ -10,6 +10,18 @@
 /* Page used for storage */
 #define PAGE_ADDR       0x01/* Page number */
 
+/**
+ * @brief 	default UDP telemetry settings, disabled
+ * @param 	settings	: pointer to the settings structure to update
+ * @returns	nothing
+ */
+static void settings_telemetry_defaults(struct settings *settings)
+{
+	IP4_ADDR(&(settings->telemetry_addr), 0, 0, 0, 0);
+	settings->telemetry_port = 0;
+	settings->telemetry_rate = 0;
+}
+
 /**
  * @brief 	default hardcoded settings
  * @returns	copy of settings structure
@@ -23,6 +35,8 @@ static struct settings settings_defaults()
 	IP4_ADDR(&(settings.netmask), 255, 255, 255, 0);
 	settings.port = 5020;
 
+	settings_telemetry_defaults(&settings);
+
 	return settings;
 }
 
@@ -80,6 +94,14 @@ struct settings settings_read()
 		lDebug(Info, "Using settings loaded from EEPROM");
 	}
 
+	/* Pages saved before UDP telemetry existed have zeroes or padding there.
+	 * Zeroes already disable it, and a zero address or port is also kept
+	 * while the telemetry is configured one value at a time. The padding
+	 * shows as a rate out of range */
+	if (settings.telemetry_rate > SETTINGS_TELEMETRY_MAX_RATE) {
+		settings_telemetry_defaults(&settings);
+	}
+
 	return settings;
 }
 
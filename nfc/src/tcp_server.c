@@ -11,78 +11,197 @@
 #include <stdint.h>
 #include "FreeRTOS.h"
 #include "task.h"
+#include "board.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
+#include "lwip/tcp.h"
 #include <lwip/netdb.h>
 #include "json_wp.h"
+#include "json_arena.h"
+#include "telemetry.h"
+#include "cmd_sched.h"
 #include "debug.h"
+#include "tcp_server.h"
+#include "net_reconfig.h"
 
 #define KEEPALIVE_IDLE              (5)
 #define KEEPALIVE_INTERVAL          (5)
 #define KEEPALIVE_COUNT             (3)
 
+/* accept() timeout, to notice a tcp_server_restart() while idle */
+#define TCP_SERVER_ACCEPT_POLL_MS   (500)
+
+/* Responses are built here, header included, so they are sent with a single
+ * call and without a heap allocation in the common case */
+static char tx_static[TCP_SND_BUF];
+
+static struct tcp_server_stats stats;
+
+/* Port to listen on, changed by tcp_server_restart() */
+static volatile uint16_t tcp_server_port;
+
+/**
+ * @brief 	adds a request to the latency statistics.
+ * @param 	cycles		:DWT cycles from the reception of the request until
+ * 						 its response was handed to the stack
+ * @returns	nothing
+ */
+void tcp_server_latency_record(uint32_t cycles)
+{
+	uint32_t us = cycles / (SystemCoreClock / 1000000);
+
+	stats.requests++;
+	stats.last_us = us;
+	stats.total_us += us;
+	if (us > stats.max_us) {
+		stats.max_us = us;
+	}
+}
+
+/**
+ * @brief 	returns the latency statistics of the command server.
+ * @returns	JSON object with the server mode, the number of requests and
+ * 			their last, maximum and average latency. Caller must free it
+ */
+JSON_Value* tcp_server_stats_json(void)
+{
+	struct tcp_server_stats snapshot;
+
+	taskENTER_CRITICAL();
+	snapshot = stats;
+	taskEXIT_CRITICAL();
+
+	JSON_Value *ans = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(ans);
+	json_object_set_string(obj, "MODE", TCP_SERVER_RAW ? "RAW" : "SOCKETS");
+	json_object_set_number(obj, "REQUESTS", snapshot.requests);
+	json_object_set_number(obj, "LAST_US", snapshot.last_us);
+	json_object_set_number(obj, "MAX_US", snapshot.max_us);
+	json_object_set_number(obj, "AVG_US",
+			snapshot.requests ?
+					(double) snapshot.total_us / snapshot.requests : 0);
+	return ans;
+}
+
+/**
+ * @brief 	sends a response buffer built by json_wp() or json_wp_serialize().
+ * @param 	sock		:connected socket
+ * @param 	tx_buffer	:buffer to send, released after sending
+ * @param 	len			:length of the buffer, header included
+ * @returns	false if an error occurred while sending
+ */
+static bool send_response(const int sock, char *tx_buffer, int len)
+{
+	bool ret = true;
+	// send() can return less bytes than supplied length.
+	// Walk-around for robust implementation.
+	int to_write = len;
+
+	while (to_write > 0) {
+		int written = send(sock, tx_buffer + (len - to_write), to_write, 0);
+		if (written < 0) {
+			lDebug(Error, "Error occurred during sending: errno %d", errno);
+			ret = false;
+			break;
+		}
+		to_write -= written;
+	}
+
+	json_wp_release(tx_static, tx_buffer);
+	return ret;
+}
+
 static void do_retransmit(const int sock)
 {
 	int len;
+	int rcv_timeout = 0;
 	char rx_buffer[1024];
 
-	do {
+	while (true) {
+		/* Telemetry subscriptions are served from this thread, using the
+		 * receive timeout to wake up when the next push is due */
+		char *tx_buffer = NULL;
+		int push_len = 0;
+
+		json_arena_begin();
+		JSON_Value *push = telemetry_push_json();
+		if (push) {
+			push_len = json_wp_serialize(push, tx_static, sizeof(tx_static),
+					&tx_buffer);
+			json_value_free(push);
+		}
+		json_arena_end();
+
+		if ((push_len > 0) && !send_response(sock, tx_buffer, push_len)) {
+			break;
+		}
+
+		/* Same for the results of the scheduled commands */
+		push_len = 0;
+		json_arena_begin();
+		push = cmd_sched_results_json();
+		if (push) {
+			push_len = json_wp_serialize(push, tx_static, sizeof(tx_static),
+					&tx_buffer);
+			json_value_free(push);
+		}
+		json_arena_end();
+
+		if ((push_len > 0) && !send_response(sock, tx_buffer, push_len)) {
+			break;
+		}
+
+		int timeout = telemetry_ms_to_next_push();
+		int sched_timeout = cmd_sched_ms_to_next_result();
+		if (sched_timeout && (!timeout || (sched_timeout < timeout))) {
+			timeout = sched_timeout;
+		}
+		if (timeout != rcv_timeout) {
+			setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(int));
+			rcv_timeout = timeout;
+		}
+
 		len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
 		if (len < 0) {
+			if ((errno == EWOULDBLOCK) && rcv_timeout) {
+				continue;
+			}
 			lDebug(Error, "Error occurred during receiving: errno %d", errno);
+			break;
 		} else if (len == 0) {
 			lDebug(Warn, "Connection closed");
+			break;
 		} else {
+			uint32_t start = DWT->CYCCNT;
 			rx_buffer[len] = 0; // Null-terminate whatever is received and treat it like a string
 
-			char *tx_buffer;
-
-			int ack_len = json_wp(rx_buffer, &tx_buffer);
+			int ack_len = json_wp(rx_buffer, tx_static, sizeof(tx_static),
+					&tx_buffer);
 
 			//lDebug(InfoLocal, "To send %d bytes: %s", ack_len, tx_buffer);
 
-			if (ack_len > 0) {
-				// send() can return less bytes than supplied length.
-				// Walk-around for robust implementation.
-				int to_write = ack_len;
-
-				char ack_buff[5];
-				sprintf(ack_buff, "%04x", ack_len);
-				send(sock, ack_buff, 4, 0);
-
-				while (to_write > 0) {
-					int written = send(sock, tx_buffer + (ack_len - to_write),
-							to_write, 0);
-					if (written < 0) {
-						lDebug(Error, "Error occurred during sending: errno %d",
-								errno);
-						goto free_buffer;
-					}
-					to_write -= written;
-				}
-
-free_buffer:
-				if (tx_buffer) {
-					vPortFree(tx_buffer);
-					tx_buffer = NULL;
-				}
+			if ((ack_len > 0) && !send_response(sock, tx_buffer, ack_len)) {
+				break;
 			}
+			tcp_server_latency_record(DWT->CYCCNT - start);
 		}
-	} while (len > 0);
+	}
+
+	telemetry_unsubscribe();
+	cmd_sched_results_drop();
 }
 
-static void tcp_server_task(void *pvParameters)
+/**
+ * @brief 	creates the listening socket.
+ * @param 	port	:TCP port to listen on
+ * @returns	the socket, -1 on error
+ */
+static int tcp_server_listen(uint16_t port)
 {
-    uint16_t port = (uintptr_t) pvParameters;
-
-	char addr_str[128];
 	int ip_protocol = 0;
-	int keepAlive = 1;
-	int keepIdle = KEEPALIVE_IDLE;
-	int keepInterval = KEEPALIVE_INTERVAL;
-	int keepCount = KEEPALIVE_COUNT;
+	int accept_timeout = TCP_SERVER_ACCEPT_POLL_MS;
 	struct sockaddr_in dest_addr;
 
 	struct sockaddr_in *dest_addr_ip4 = (struct sockaddr_in*) &dest_addr;
@@ -94,8 +213,7 @@ static void tcp_server_task(void *pvParameters)
 	int listen_sock = socket(AF_INET, SOCK_STREAM, ip_protocol);
 	if (listen_sock < 0) {
 		lDebug(Error, "Unable to create socket: errno %d", errno);
-		vTaskDelete(NULL);
-		return;
+		return -1;
 	}
 	int opt = 1;
 	setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
@@ -104,6 +222,9 @@ static void tcp_server_task(void *pvParameters)
     // if both protocols used at the same time (used in CI)
     setsockopt(listen_sock, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt));
 #endif
+	// accept() returns EWOULDBLOCK once in a while to check the port
+	setsockopt(listen_sock, SOL_SOCKET, SO_RCVTIMEO, &accept_timeout,
+			sizeof(int));
 
 	lDebug(Info, "Socket created");
 
@@ -112,28 +233,61 @@ static void tcp_server_task(void *pvParameters)
 	if (err != 0) {
 		lDebug(Error, "Socket unable to bind: errno %d", errno);
 		lDebug(Error, "IPPROTO: %d", AF_INET);
-		goto CLEAN_UP;
+		close(listen_sock);
+		return -1;
 	}
 	lDebug(Info, "Socket bound, port %d", port);
 
 	err = listen(listen_sock, 1);
 	if (err != 0) {
 		lDebug(Error, "Error occurred during listen: errno %d", errno);
-		goto CLEAN_UP;
+		close(listen_sock);
+		return -1;
 	}
 
-	while (1) {
+	lDebug(Info, "Socket listening");
+	return listen_sock;
+}
+
+static void tcp_server_task(void *pvParameters)
+{
+	char addr_str[128];
+	int keepAlive = 1;
+	int keepIdle = KEEPALIVE_IDLE;
+	int keepInterval = KEEPALIVE_INTERVAL;
+	int keepCount = KEEPALIVE_COUNT;
+	int noDelay = 1;
+	int listen_sock = -1;
+	uint16_t port = 0;
 
-		lDebug(Info, "Socket listening");
+	while (1) {
+		/* (Re)started on the port set by tcp_server_restart() */
+		if (port != tcp_server_port) {
+			if (listen_sock >= 0) {
+				close(listen_sock);
+			}
+			port = tcp_server_port;
+			listen_sock = tcp_server_listen(port);
+		}
+		if (listen_sock < 0) {
+			/* Retried until it succeeds or the port changes */
+			vTaskDelay(pdMS_TO_TICKS(TCP_SERVER_ACCEPT_POLL_MS));
+			port = 0;
+			continue;
+		}
 
 		struct sockaddr source_addr; // Large enough for both IPv4 or IPv6
 		socklen_t addr_len = sizeof(source_addr);
 		int sock = accept(listen_sock, (struct sockaddr* ) &source_addr,
 				&addr_len);
 		if (sock < 0) {
+			if (errno == EWOULDBLOCK) {
+				continue;
+			}
 			lDebug(Error, "Unable to accept connection: errno %d", errno);
 			break;
 		}
+		net_reconfig_client_connected();
 
 		// Set tcp keepalive option
 		setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
@@ -141,6 +295,8 @@ static void tcp_server_task(void *pvParameters)
 		setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval,
 				sizeof(int));
 		setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
+		// Responses go out in one piece, don't wait for the previous ACK
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(int));
 		// Convert ip address to string
 		if (source_addr.sa_family == PF_INET) {
 			inet_ntoa_r(((struct sockaddr_in* )&source_addr)->sin_addr,
@@ -159,15 +315,26 @@ static void tcp_server_task(void *pvParameters)
 		close(sock);
 	}
 
-CLEAN_UP:
 	close(listen_sock);
 	vTaskDelete(NULL);
 }
 
+/**
+ * @brief 	moves the command server to another port. The listening socket
+ * 			is recreated once the current client, if any, is gone.
+ * @param 	port	:TCP port to listen on
+ * @returns	nothing
+ */
+void tcp_server_restart(uint16_t port)
+{
+	tcp_server_port = port;
+}
+
 /*-----------------------------------------------------------------------------------*/
 void stackIp_ThreadInit(uint16_t port)
 {
-	sys_thread_new("tcp_thread", tcp_server_task, (void*) (uintptr_t) port,
+	tcp_server_port = port;
+	sys_thread_new("tcp_thread", tcp_server_task, NULL,
 	//DEFAULT_THREAD_STACKSIZE,
 	1024,
 	configMAX_PRIORITIES - 2);
@@ -0,0 +1,393 @@
+#include "tcp_server_raw.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "board.h"
+
+#include "lwip/opt.h"
+#include "lwip/tcp.h"
+#include "lwip/tcp_impl.h"
+#include "lwip/tcpip.h"
+#include "lwip/timers.h"
+#include "json_wp.h"
+#include "json_arena.h"
+#include "telemetry.h"
+#include "cmd_sched.h"
+#include "tcp_server.h"
+#include "net_reconfig.h"
+#include "debug.h"
+
+/**
+ * @brief Command server built on the lwIP raw API. Every callback runs in
+ * the tcpip thread, so a request is parsed and answered without the
+ * api_msg round trips of the socket layer and without a task of its own.
+ * The commands that may block the stack, see cmd_may_block(), are handed
+ * to cmd_sched through json_wp_nonblocking(). Selected with TCP_SERVER_RAW.
+ */
+
+#if TCP_SERVER_RAW
+
+#define KEEPALIVE_IDLE_MS           (5000)
+#define KEEPALIVE_INTERVAL_MS       (5000)
+#define KEEPALIVE_COUNT             (3)
+
+/* tcp_poll() interval in TCP coarse timer ticks (500 ms) */
+#define TCP_SERVER_RAW_POLL         4
+
+/**
+ * @struct 	tcp_server_raw
+ * @brief	state of the client connection. Only one client is served at a
+ * 			time, as with the socket server. Only used from the tcpip thread.
+ */
+struct tcp_server_raw {
+	struct tcp_pcb *listen_pcb;
+	struct tcp_pcb *pcb;		/* Connected client, NULL if none */
+	char *tx;					/* Response being sent, NULL if none */
+	int tx_len;
+	int tx_queued;				/* Bytes of tx already given to tcp_write() */
+	bool push_armed;			/* tcp_server_raw_push() timeout registered */
+};
+
+static struct tcp_server_raw server;
+
+static char rx_buffer[TCP_SERVER_RAW_RX_SIZE];
+
+/* Responses are built here, header included, as in the socket server */
+static char tx_static[TCP_SND_BUF];
+
+static void tcp_server_raw_push(void *arg);
+static void tcp_server_raw_arm_push(void);
+
+/**
+ * @brief 	queues as much of the pending response as the send buffer takes,
+ * 			the rest goes from the sent and poll callbacks.
+ * @returns	false if the connection failed
+ */
+static bool tcp_server_raw_flush(void)
+{
+	while (server.tx && (server.tx_queued < server.tx_len)) {
+		int len = server.tx_len - server.tx_queued;
+		if (len > tcp_sndbuf(server.pcb)) {
+			len = tcp_sndbuf(server.pcb);
+		}
+		if (!len) {
+			break;
+		}
+
+		err_t err = tcp_write(server.pcb, server.tx + server.tx_queued, len,
+				TCP_WRITE_FLAG_COPY);
+		if (err == ERR_MEM) {
+			break;
+		}
+		if (err != ERR_OK) {
+			lDebug(Error, "Error occurred during sending: err %d", err);
+			return false;
+		}
+		server.tx_queued += len;
+	}
+
+	if (server.tx && (server.tx_queued == server.tx_len)) {
+		json_wp_release(tx_static, server.tx);
+		server.tx = NULL;
+	}
+
+	tcp_output(server.pcb);
+	return true;
+}
+
+/**
+ * @brief 	starts sending a response built by json_wp_serialize().
+ * @param 	*tx_buffer	:buffer to send, released once queued
+ * @param 	len			:length of the buffer, header included
+ * @returns	false if the connection failed
+ */
+static bool tcp_server_raw_send(char *tx_buffer, int len)
+{
+	server.tx = tx_buffer;
+	server.tx_len = len;
+	server.tx_queued = 0;
+	return tcp_server_raw_flush();
+}
+
+/**
+ * @brief 	forgets the client, stopping what was served to it.
+ * @returns	nothing
+ */
+static void tcp_server_raw_forget(void)
+{
+	if (server.tx) {
+		json_wp_release(tx_static, server.tx);
+		server.tx = NULL;
+	}
+	if (server.push_armed) {
+		sys_untimeout(tcp_server_raw_push, NULL);
+		server.push_armed = false;
+	}
+	server.pcb = NULL;
+	telemetry_unsubscribe();
+	cmd_sched_results_drop();
+}
+
+/**
+ * @brief 	closes the client connection.
+ * @returns	ERR_ABRT if it had to be aborted, callbacks must return it then
+ */
+static err_t tcp_server_raw_close(struct tcp_pcb *pcb)
+{
+	tcp_recv(pcb, NULL);
+	tcp_sent(pcb, NULL);
+	tcp_err(pcb, NULL);
+	tcp_poll(pcb, NULL, 0);
+	tcp_server_raw_forget();
+
+	if (tcp_close(pcb) != ERR_OK) {
+		tcp_abort(pcb);
+		return ERR_ABRT;
+	}
+	return ERR_OK;
+}
+
+/**
+ * @brief 	serializes and sends a push, unless a response is still going out.
+ * @returns	false if the connection failed
+ */
+static bool tcp_server_raw_push_json(JSON_Value *(*build)(void))
+{
+	char *tx_buffer = NULL;
+	int push_len = 0;
+
+	if (server.tx) {
+		return true;
+	}
+
+	json_arena_begin();
+	JSON_Value *push = build();
+	if (push) {
+		push_len = json_wp_serialize(push, tx_static, sizeof(tx_static),
+				&tx_buffer);
+		json_value_free(push);
+	}
+	json_arena_end();
+
+	return (push_len <= 0) || tcp_server_raw_send(tx_buffer, push_len);
+}
+
+/**
+ * @brief 	sends the telemetry and the results of the scheduled commands
+ * 			that are due.
+ */
+static void tcp_server_raw_push(void *arg)
+{
+	server.push_armed = false;
+	if (!server.pcb) {
+		return;
+	}
+
+	if (!tcp_server_raw_push_json(telemetry_push_json)
+			|| !tcp_server_raw_push_json(cmd_sched_results_json)) {
+		tcp_abort(server.pcb);
+		tcp_server_raw_forget();
+		return;
+	}
+
+	tcp_server_raw_arm_push();
+}
+
+/**
+ * @brief 	registers the timeout for the next telemetry push or scheduled
+ * 			command result, replacing the previous one.
+ */
+static void tcp_server_raw_arm_push(void)
+{
+	int timeout = telemetry_ms_to_next_push();
+	int sched_timeout = cmd_sched_ms_to_next_result();
+	if (sched_timeout && (!timeout || (sched_timeout < timeout))) {
+		timeout = sched_timeout;
+	}
+
+	if (server.push_armed) {
+		sys_untimeout(tcp_server_raw_push, NULL);
+		server.push_armed = false;
+	}
+	if (timeout && server.pcb) {
+		sys_timeout(timeout, tcp_server_raw_push, NULL);
+		server.push_armed = true;
+	}
+}
+
+static err_t tcp_server_raw_recv(void *arg, struct tcp_pcb *pcb,
+		struct pbuf *p, err_t err)
+{
+	if (!p) {
+		lDebug(Warn, "Connection closed");
+		return tcp_server_raw_close(pcb);
+	}
+	if (err != ERR_OK) {
+		pbuf_free(p);
+		return err;
+	}
+
+	/* Still sending the previous response. lwIP keeps the request and
+	 * offers it again once the response is queued */
+	if (server.tx) {
+		return ERR_MEM;
+	}
+
+	uint32_t start = DWT->CYCCNT;
+
+	u16_t len = pbuf_copy_partial(p, rx_buffer, sizeof(rx_buffer) - 1, 0);
+	rx_buffer[len] = 0;
+	tcp_recved(pcb, p->tot_len);
+	pbuf_free(p);
+
+	char *tx_buffer = NULL;
+	int ack_len = json_wp_nonblocking(rx_buffer, tx_static, sizeof(tx_static),
+			&tx_buffer);
+
+	if ((ack_len > 0) && !tcp_server_raw_send(tx_buffer, ack_len)) {
+		tcp_abort(pcb);
+		tcp_server_raw_forget();
+		return ERR_ABRT;
+	}
+	tcp_server_latency_record(DWT->CYCCNT - start);
+
+	/* The request may have subscribed or scheduled commands */
+	tcp_server_raw_arm_push();
+	return ERR_OK;
+}
+
+static err_t tcp_server_raw_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+	if (!server.tx) {
+		return ERR_OK;
+	}
+
+	if (!tcp_server_raw_flush()) {
+		tcp_abort(pcb);
+		tcp_server_raw_forget();
+		return ERR_ABRT;
+	}
+
+	/* A request that arrived while sending can be served now */
+	if (!server.tx && pcb->refused_data) {
+		return tcp_process_refused_data(pcb);
+	}
+	return ERR_OK;
+}
+
+static err_t tcp_server_raw_poll(void *arg, struct tcp_pcb *pcb)
+{
+	/* Retries a tcp_write() that failed for lack of memory with nothing
+	 * in flight, so no sent callback would come */
+	return tcp_server_raw_sent(arg, pcb, 0);
+}
+
+static void tcp_server_raw_err(void *arg, err_t err)
+{
+	/* The pcb is already freed */
+	lDebug(Error, "Connection error: err %d", err);
+	tcp_server_raw_forget();
+}
+
+static err_t tcp_server_raw_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+	char addr_str[16];
+
+	if ((err != ERR_OK) || !pcb) {
+		return ERR_VAL;
+	}
+	tcp_accepted(server.listen_pcb);
+
+	/* One client at a time, lwIP aborts the refused connection */
+	if (server.pcb) {
+		lDebug(Warn, "Connection refused, a client is already connected");
+		return ERR_MEM;
+	}
+
+	server.pcb = pcb;
+	net_reconfig_client_connected();
+	tcp_recv(pcb, tcp_server_raw_recv);
+	tcp_sent(pcb, tcp_server_raw_sent);
+	tcp_err(pcb, tcp_server_raw_err);
+	tcp_poll(pcb, tcp_server_raw_poll, TCP_SERVER_RAW_POLL);
+
+	ip_set_option(pcb, SOF_KEEPALIVE);
+	pcb->keep_idle = KEEPALIVE_IDLE_MS;
+#if LWIP_TCP_KEEPALIVE
+	pcb->keep_intvl = KEEPALIVE_INTERVAL_MS;
+	pcb->keep_cnt = KEEPALIVE_COUNT;
+#endif
+	// Responses go out in one piece, don't wait for the previous ACK
+	tcp_nagle_disable(pcb);
+
+	lDebug(Info, "Raw server accepted ip address: %s",
+			ipaddr_ntoa_r(&pcb->remote_ip, addr_str, sizeof(addr_str)));
+	return ERR_OK;
+}
+
+/**
+ * @brief 	creates the listening pcb, runs in the tcpip thread.
+ */
+static void tcp_server_raw_start(void *arg)
+{
+	uint16_t port = (uintptr_t) arg;
+
+	struct tcp_pcb *pcb = tcp_new();
+	if (!pcb) {
+		lDebug(Error, "Unable to create pcb");
+		return;
+	}
+	ip_set_option(pcb, SOF_REUSEADDR);
+
+	if (tcp_bind(pcb, IP_ADDR_ANY, port) != ERR_OK) {
+		lDebug(Error, "Unable to bind port %d", port);
+		tcp_close(pcb);
+		return;
+	}
+
+	server.listen_pcb = tcp_listen_with_backlog(pcb, 1);
+	if (!server.listen_pcb) {
+		lDebug(Error, "Unable to listen");
+		tcp_close(pcb);
+		return;
+	}
+	tcp_accept(server.listen_pcb, tcp_server_raw_accept);
+
+	lDebug(Info, "Raw server listening, port %d", port);
+}
+
+/**
+ * @brief 	starts the raw API command server.
+ * @param 	port	:TCP port to listen on
+ * @returns	nothing
+ * @note	call once tcpip_init() is done.
+ */
+void tcp_server_raw_init(uint16_t port)
+{
+	tcpip_callback_with_block(tcp_server_raw_start, (void*) (uintptr_t) port,
+			1);
+}
+
+/**
+ * @brief 	moves the listener to another port, dropping the client.
+ * @param 	port	:TCP port to listen on
+ * @returns	nothing
+ * @note	call from the tcpip thread.
+ */
+void tcp_server_raw_restart(uint16_t port)
+{
+	if (server.pcb) {
+		tcp_server_raw_close(server.pcb);
+	}
+	if (server.listen_pcb) {
+		tcp_close(server.listen_pcb);
+		server.listen_pcb = NULL;
+	}
+	tcp_server_raw_start((void*) (uintptr_t) port);
+}
+
+#endif /* TCP_SERVER_RAW */
@@ -0,0 +1,256 @@
+#include "telemetry.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "debug.h"
+#include "mot_pap.h"
+#include "temperature_ds18b20.h"
+
+extern int count_z;
+extern int count_b;
+extern int count_a;
+
+extern struct mot_pap x_axis;
+extern struct mot_pap y_axis;
+extern struct mot_pap z_axis;
+
+/**
+ * @struct 	telemetry_subscription
+ * @brief	state of the telemetry subscription of the connected client.
+ */
+struct telemetry_subscription {
+	bool active;
+	bool delta;
+	uint32_t fields;
+	TickType_t period;
+	TickType_t next_push;
+	uint32_t seq;
+	bool last_valid;
+	struct telemetry_snapshot last;
+};
+
+static struct telemetry_subscription subscription;
+
+static const char *const field_names[] = { "positions", "encoders", "stalled",
+		"temperatures" };
+
+/**
+ * @brief 	samples every telemetry field group at the current tick.
+ * @param 	snap	: pointer to the snapshot to fill
+ * @returns	nothing
+ */
+void telemetry_sample(struct telemetry_snapshot *snap)
+{
+	struct mot_pap *axes[] = { &x_axis, &y_axis, &z_axis };
+
+	snap->tick = xTaskGetTickCount();
+
+	for (int i = 0; i < 3; i++) {
+		snap->posAct[i] = axes[i]->posAct;
+		snap->posCmd[i] = axes[i]->posCmd;
+		snap->stalled[i] = axes[i]->stalled;
+	}
+
+	snap->count_a = count_a;
+	snap->count_b = count_b;
+	snap->count_z = count_z;
+
+	temperature_ds18b20_get(0, &snap->temperatures[0]);
+	temperature_ds18b20_get(1, &snap->temperatures[1]);
+}
+
+/**
+ * @brief 	translates an array of field group names into a telemetry_fields mask.
+ * @param 	names	: JSON array of strings, NULL selects every group
+ * @returns	the mask of the requested field groups
+ */
+uint32_t telemetry_fields_from_json(JSON_Array const *names)
+{
+	uint32_t fields = 0;
+
+	if (!names) {
+		return TELEMETRY_ALL;
+	}
+
+	for (int i = 0; i < json_array_get_count(names); i++) {
+		char const *name = json_array_get_string(names, i);
+		if (!name) {
+			continue;
+		}
+
+		for (int f = 0; f < (sizeof(field_names) / sizeof(field_names[0]));
+				f++) {
+			if (!strcmp(name, field_names[f])) {
+				fields |= (1 << f);
+			}
+		}
+	}
+	return fields;
+}
+
+/**
+ * @brief 	registers the telemetry subscription of the connected client.
+ * @param 	fields		: mask of enum telemetry_fields to push
+ * @param 	period_ms	: push period, clamped to TELEMETRY_MIN_PERIOD_MS
+ * @param 	delta		: if true only the groups that changed are pushed
+ * @returns	false if no valid field group was requested
+ */
+bool telemetry_subscribe(uint32_t fields, uint32_t period_ms, bool delta)
+{
+	if (!(fields & TELEMETRY_ALL)) {
+		return false;
+	}
+
+	if (period_ms < TELEMETRY_MIN_PERIOD_MS) {
+		period_ms = TELEMETRY_MIN_PERIOD_MS;
+	}
+
+	subscription.fields = fields & TELEMETRY_ALL;
+	subscription.period = pdMS_TO_TICKS(period_ms);
+	subscription.delta = delta;
+	subscription.seq = 0;
+	subscription.last_valid = false;
+	subscription.next_push = xTaskGetTickCount();
+	subscription.active = true;
+
+	lDebug(Info, "Telemetry subscribed, fields: 0x%lx, period: %lu ms",
+			subscription.fields, period_ms);
+	return true;
+}
+
+/**
+ * @brief 	stops pushing telemetry to the connected client.
+ * @returns	nothing
+ */
+void telemetry_unsubscribe(void)
+{
+	if (subscription.active) {
+		lDebug(Info, "Telemetry unsubscribed after %lu pushes",
+				subscription.seq);
+	}
+	subscription.active = false;
+}
+
+/**
+ * @brief 	returns if there is an active telemetry subscription.
+ */
+bool telemetry_subscribed(void)
+{
+	return subscription.active;
+}
+
+/**
+ * @brief 	returns the time left for the next telemetry push.
+ * @returns	0 if there is no active subscription
+ * @returns	the milliseconds to wait, at least 1
+ */
+uint32_t telemetry_ms_to_next_push(void)
+{
+	if (!subscription.active) {
+		return 0;
+	}
+
+	int32_t diff = (int32_t) (subscription.next_push - xTaskGetTickCount());
+	if (diff <= 0) {
+		return 1;
+	}
+	return diff * portTICK_PERIOD_MS;
+}
+
+/**
+ * @brief 	builds the telemetry push message if it is due.
+ * @returns	NULL if there is no subscription or the push is not due yet
+ * @returns	JSON object to be sent to the client. Caller must free it
+ * @note	in delta mode field groups are only included if any value changed
+ * 			since the last push. The first push is always a full snapshot.
+ */
+JSON_Value* telemetry_push_json(void)
+{
+	struct telemetry_snapshot snap;
+	struct telemetry_snapshot *last = &subscription.last;
+
+	if (!subscription.active) {
+		return NULL;
+	}
+
+	TickType_t now = xTaskGetTickCount();
+	if ((int32_t) (subscription.next_push - now) > 0) {
+		return NULL;
+	}
+
+	subscription.next_push += subscription.period;
+	if ((int32_t) (subscription.next_push - now) <= 0) {
+		/* Fell behind, don't try to catch up with a burst of pushes */
+		subscription.next_push = now + subscription.period;
+	}
+
+	telemetry_sample(&snap);
+
+	bool full = !subscription.delta || !subscription.last_valid;
+	uint32_t fields = subscription.fields;
+
+	if (!full) {
+		if (!memcmp(snap.posAct, last->posAct, sizeof(snap.posAct))
+				&& !memcmp(snap.posCmd, last->posCmd, sizeof(snap.posCmd))) {
+			fields &= ~TELEMETRY_POSITIONS;
+		}
+		if ((snap.count_a == last->count_a) && (snap.count_b == last->count_b)
+				&& (snap.count_z == last->count_z)) {
+			fields &= ~TELEMETRY_ENCODERS;
+		}
+		if (!memcmp(snap.stalled, last->stalled, sizeof(snap.stalled))) {
+			fields &= ~TELEMETRY_STALLED;
+		}
+		if (!memcmp(snap.temperatures, last->temperatures,
+				sizeof(snap.temperatures))) {
+			fields &= ~TELEMETRY_TEMPERATURES;
+		}
+	}
+
+	JSON_Value *data = json_value_init_object();
+	JSON_Object *obj = json_value_get_object(data);
+
+	json_object_set_number(obj, "seq", ++subscription.seq);
+	json_object_set_number(obj, "tick", snap.tick);
+	json_object_set_boolean(obj, "full", full);
+
+	if (fields & TELEMETRY_POSITIONS) {
+		json_object_dotset_number(obj, "positions.x_posAct", snap.posAct[0]);
+		json_object_dotset_number(obj, "positions.y_posAct", snap.posAct[1]);
+		json_object_dotset_number(obj, "positions.z_posAct", snap.posAct[2]);
+		json_object_dotset_number(obj, "positions.x_posCmd", snap.posCmd[0]);
+		json_object_dotset_number(obj, "positions.y_posCmd", snap.posCmd[1]);
+		json_object_dotset_number(obj, "positions.z_posCmd", snap.posCmd[2]);
+	}
+
+	if (fields & TELEMETRY_ENCODERS) {
+		json_object_dotset_number(obj, "encoders.cuentas A", snap.count_z);
+		json_object_dotset_number(obj, "encoders.cuentas B", snap.count_b);
+		json_object_dotset_number(obj, "encoders.cuentas Z", snap.count_a);
+	}
+
+	if (fields & TELEMETRY_STALLED) {
+		json_object_dotset_boolean(obj, "stalled.x_axis", snap.stalled[0]);
+		json_object_dotset_boolean(obj, "stalled.y_axis", snap.stalled[1]);
+		json_object_dotset_boolean(obj, "stalled.z_axis", snap.stalled[2]);
+	}
+
+	if (fields & TELEMETRY_TEMPERATURES) {
+		json_object_dotset_number(obj, "temperatures.TEMP1",
+				(double) snap.temperatures[0]);
+		json_object_dotset_number(obj, "temperatures.TEMP2",
+				(double) snap.temperatures[1]);
+	}
+
+	*last = snap;
+	subscription.last_valid = true;
+
+	JSON_Value *ans = json_value_init_object();
+	json_object_set_value(json_value_get_object(ans), "TELEMETRY", data);
+	return ans;
+}
@@ -0,0 +1,178 @@
+#include "telemetry_udp.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lwip/api.h"
+#include "lwip/ip.h"
+#include "lwip/udp.h"
+#include "debug.h"
+#include "rtos_static.h"
+#include "telemetry.h"
+
+#define TELEMETRY_UDP_TASK_PRIORITY ( configMAX_PRIORITIES - 3 )
+
+/**
+ * @struct 	telemetry_udp
+ * @brief	destination, rate and counters of the UDP telemetry sender.
+ */
+struct telemetry_udp {
+	ip_addr_t addr;
+	uint16_t port;
+	uint16_t rate;
+	uint32_t seq;
+	uint32_t errors;
+};
+
+static struct telemetry_udp telemetry_udp;
+
+static TaskHandle_t telemetry_udp_task_handle = NULL;
+
+/**
+ * @brief 	returns if the sender has a valid destination and rate.
+ */
+static bool telemetry_udp_enabled(void)
+{
+	return (telemetry_udp.rate != 0) && (telemetry_udp.port != 0)
+			&& !ip_addr_isany(&telemetry_udp.addr);
+}
+
+/**
+ * @brief 	fills a datagram with a fresh telemetry snapshot
+ * @param 	dgram	: pointer to the datagram to fill
+ * @returns	nothing
+ */
+static void telemetry_udp_fill(struct telemetry_udp_datagram *dgram)
+{
+	struct telemetry_snapshot snap;
+
+	telemetry_sample(&snap);
+
+	dgram->magic = TELEMETRY_UDP_MAGIC;
+	dgram->version = TELEMETRY_UDP_VERSION;
+	dgram->size = sizeof(struct telemetry_udp_datagram);
+	dgram->seq = ++telemetry_udp.seq;
+	dgram->tick = snap.tick;
+	for (int i = 0; i < 3; i++) {
+		dgram->posAct[i] = snap.posAct[i];
+		dgram->posCmd[i] = snap.posCmd[i];
+		dgram->stalled[i] = snap.stalled[i];
+	}
+	dgram->count_a = snap.count_a;
+	dgram->count_b = snap.count_b;
+	dgram->count_z = snap.count_z;
+	dgram->reserved = 0;
+	dgram->temperatures[0] = snap.temperatures[0];
+	dgram->temperatures[1] = snap.temperatures[1];
+}
+
+static void telemetry_udp_task(void *par)
+{
+	struct netconn *conn = netconn_new(NETCONN_UDP);
+	struct netbuf *buf = netbuf_new();
+
+	if (!conn || !buf) {
+		lDebug(Error, "Telemetry UDP: unable to create netconn");
+		vTaskDelete(NULL);
+		return;
+	}
+
+	/* Allow sending to the subnet broadcast address */
+	ip_set_option(conn->pcb.udp, SOF_BROADCAST);
+
+	TickType_t last_wake = xTaskGetTickCount();
+
+	while (true) {
+		if (!telemetry_udp_enabled()) {
+			/* Sleep until telemetry_udp_config() enables the sender */
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			last_wake = xTaskGetTickCount();
+			continue;
+		}
+
+		TickType_t period = configTICK_RATE_HZ / telemetry_udp.rate;
+		if (period == 0) {
+			period = 1;
+		}
+		vTaskDelayUntil(&last_wake, period);
+
+		struct telemetry_udp_datagram *dgram = netbuf_alloc(buf,
+				sizeof(struct telemetry_udp_datagram));
+		if (!dgram) {
+			telemetry_udp.errors++;
+			continue;
+		}
+
+		telemetry_udp_fill(dgram);
+
+		ip_addr_t addr = telemetry_udp.addr;
+		if (netconn_sendto(conn, buf, &addr, telemetry_udp.port) != ERR_OK) {
+			telemetry_udp.errors++;
+		}
+	}
+}
+
+/**
+ * @brief 	changes the UDP telemetry destination and rate at runtime.
+ * @param 	addr	: unicast, broadcast or multicast destination address
+ * @param 	port	: destination UDP port
+ * @param 	rate	: datagrams per second, 0 stops the sender
+ * @returns	nothing
+ */
+void telemetry_udp_config(ip_addr_t addr, uint16_t port, uint16_t rate)
+{
+	if (rate > SETTINGS_TELEMETRY_MAX_RATE) {
+		rate = SETTINGS_TELEMETRY_MAX_RATE;
+	}
+
+	taskENTER_CRITICAL();
+	telemetry_udp.addr = addr;
+	telemetry_udp.port = port;
+	telemetry_udp.rate = rate;
+	taskEXIT_CRITICAL();
+
+	if (telemetry_udp_task_handle) {
+		xTaskNotifyGive(telemetry_udp_task_handle);
+	}
+}
+
+/**
+ * @brief 	creates the UDP telemetry sender task with the stored configuration.
+ * @param 	settings	: settings read from EEPROM
+ * @returns	nothing
+ */
+void telemetry_udp_init(struct settings settings)
+{
+	telemetry_udp_config(settings.telemetry_addr, settings.telemetry_port,
+			settings.telemetry_rate);
+
+	telemetry_udp_task_handle = rtos_task_create(telemetry_udp_task,
+			"TelemetryUDP", configMINIMAL_STACK_SIZE * 2, NULL,
+			TELEMETRY_UDP_TASK_PRIORITY, RTOS_BANK_RAMAHB);
+	lDebug(Info, "TelemetryUDP: task created");
+}
+
+/**
+ * @brief 	returns the UDP telemetry configuration and counters.
+ * @returns	JSON object. Caller must free it
+ */
+JSON_Value* telemetry_udp_json(void)
+{
+	char addr_str[16];
+	JSON_Value *ans = json_value_init_object();
+	json_object_set_string(json_value_get_object(ans), "addr",
+			ipaddr_ntoa_r(&telemetry_udp.addr, addr_str, sizeof(addr_str)));
+	json_object_set_number(json_value_get_object(ans), "port",
+			telemetry_udp.port);
+	json_object_set_number(json_value_get_object(ans), "rate",
+			telemetry_udp.rate);
+	json_object_set_number(json_value_get_object(ans), "sent",
+			telemetry_udp.seq);
+	json_object_set_number(json_value_get_object(ans), "errors",
+			telemetry_udp.errors);
+	return ans;
+}
@@ -5,6 +5,7 @@
 #include "one-wire.h"
 #include "ds18b20.h"
 #include "temperature_ds18b20.h"
+#include "rtos_static.h"
 
 #define STB_DEFINE
 
@@ -81,7 +82,7 @@ void temperature_ds18b20_init()
 	uint8_t err = ds18b20_search_and_assign_ROM_codes();
 	lDebug(Info, "search_And_assign_ROM: %i", err);
 	//lDebug(Info, "read_ROM: %i", ds18b20_read_ROM(0));
-	xTaskCreate(temperature_ds18b20_task, "DS18B20", configMINIMAL_STACK_SIZE * 2, NULL,
-			TEMPERATURE_DS18B20_TASK_PRIORITY, NULL);
+	rtos_task_create(temperature_ds18b20_task, "DS18B20", configMINIMAL_STACK_SIZE * 2, NULL,
+			TEMPERATURE_DS18B20_TASK_PRIORITY, RTOS_BANK_RAMAHB);
 	lDebug(Info, "DS18B20: task created");
 }
@@ -1,3 +1,7 @@
+/* Called from the step ISRs, only errors are compiled in */
+#define LOG_MODULE_NAME		"tmr"
+#define LOG_MODULE_LEVEL	Error
+
 #include <stdint.h>
 #include <stdbool.h>
 #include <x_axis.h>
@@ -8,6 +12,7 @@
 
 #include "debug.h"
 #include "mot_pap.h"
+#include "mem_sections.h"
 
 #define TMR_INTERRUPT_PRIORITY 		( configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 2 )
 
@@ -17,6 +22,8 @@
  */
 void tmr_init(struct tmr *me)
 {
+	debugModuleThisRegister();
+
 	Chip_TIMER_Init(me->lpc_timer);
 	Chip_RGU_TriggerReset(me->rgu_timer_rst);
 
@@ -103,7 +110,7 @@ uint32_t tmr_started(struct tmr *me)
  * @note	Determine if the match interrupt for the passed timer and match
  * 			counter is pending. If the interrupt is pending clears the match counter
  */
-bool tmr_match_pending(struct tmr *me)
+bool RAMFUNC tmr_match_pending(struct tmr *me)
 {
 	bool ret = Chip_TIMER_MatchPending(me->lpc_timer, 1);
 	if (ret) {
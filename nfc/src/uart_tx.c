@@ -0,0 +1,212 @@
+#include "uart_tx.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#if defined(__NEWLIB__)
+#include <reent.h>
+#endif
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "board.h"
+
+#define UART_TX_INTERRUPT_PRIORITY 	( configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 3 )
+
+/**
+ * @struct 	uart_tx
+ * @brief	console output ring. Writers move head, the DMA completion
+ * 			interrupt moves tail. Both run with interrupts masked up to
+ * 			configMAX_SYSCALL_INTERRUPT_PRIORITY.
+ */
+struct uart_tx {
+	bool initialized;
+	enum uart_tx_overflow overflow;
+	uint8_t dma_ch;
+	uint32_t head;
+	uint32_t tail;
+	uint32_t dma_len;			/* Bytes in flight, 0 if the DMA is idle */
+	uint32_t dropped;
+	char buf[UART_TX_BUF_SIZE];
+};
+
+static struct uart_tx uart_tx;
+
+/**
+ * @brief 	starts a DMA transfer with the longest contiguous span in the ring.
+ * @note	must be called with interrupts masked and the DMA idle.
+ */
+static void uart_tx_start(void)
+{
+	uint32_t offset = uart_tx.tail & (UART_TX_BUF_SIZE - 1);
+	uint32_t len = uart_tx.head - uart_tx.tail;
+
+	if (len > UART_TX_BUF_SIZE - offset) {
+		len = UART_TX_BUF_SIZE - offset;
+	}
+	if (!len) {
+		return;
+	}
+
+	uart_tx.dma_len = len;
+	Chip_GPDMA_Transfer(LPC_GPDMA, uart_tx.dma_ch,
+			(uint32_t) &uart_tx.buf[offset], UART_TX_DMA_CONN,
+			GPDMA_TRANSFERTYPE_M2P_CONTROLLER_DMA, len);
+}
+
+/**
+ * @brief 	GPDMA interrupt, releases the sent span and starts the next one.
+ */
+void DMA_IRQHandler(void)
+{
+	if (Chip_GPDMA_IntGetStatus(LPC_GPDMA, GPDMA_STAT_INT, uart_tx.dma_ch)) {
+		Chip_GPDMA_Interrupt(LPC_GPDMA, uart_tx.dma_ch);
+
+		uart_tx.tail += uart_tx.dma_len;
+		uart_tx.dma_len = 0;
+		uart_tx_start();
+	}
+}
+
+/**
+ * @brief 	sets up the GPDMA channel feeding DEBUG_UART. Until this is called
+ * 			the console output is written with Chip_UART_SendBlocking().
+ * @param 	overflow	: what to do when the ring is full
+ * @returns	nothing
+ */
+void uart_tx_init(enum uart_tx_overflow overflow)
+{
+	uart_tx.overflow = overflow;
+
+	Chip_GPDMA_Init(LPC_GPDMA);
+	uart_tx.dma_ch = Chip_GPDMA_GetFreeChannel(LPC_GPDMA, UART_TX_DMA_CONN);
+
+	Chip_UART_SetupFIFOS(DEBUG_UART, UART_FCR_FIFO_EN | UART_FCR_TX_RS |
+	UART_FCR_DMAMODE_SEL | UART_FCR_TRG_LEV0);
+
+	NVIC_SetPriority(DMA_IRQn, UART_TX_INTERRUPT_PRIORITY);
+	NVIC_EnableIRQ(DMA_IRQn);
+
+	uart_tx.initialized = true;
+}
+
+/**
+ * @brief 	changes the behavior when the ring is full.
+ * @param 	overflow	: UART_TX_DROP or UART_TX_WAIT
+ * @returns	nothing
+ */
+void uart_tx_set_overflow(enum uart_tx_overflow overflow)
+{
+	uart_tx.overflow = overflow;
+}
+
+/**
+ * @brief 	returns if the caller can block waiting for room in the ring.
+ */
+static bool uart_tx_can_wait(void)
+{
+	return (uart_tx.overflow == UART_TX_WAIT) && !xPortIsInsideInterrupt()
+			&& (__get_BASEPRI() == 0)
+			&& (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+}
+
+/**
+ * @brief 	queues bytes for the console. Returns as soon as they are copied.
+ * @param 	buf		: bytes to send
+ * @param 	len		: number of bytes
+ * @returns	the number of bytes queued, the rest were dropped and counted
+ * @note	can be called from ISRs and critical sections, where it never waits.
+ */
+size_t uart_tx_write(const char *buf, size_t len)
+{
+	size_t written = 0;
+
+	if (!uart_tx.initialized) {
+		Chip_UART_SendBlocking(DEBUG_UART, buf, len);
+		return len;
+	}
+
+	while (written < len) {
+		UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+
+		uint32_t room = UART_TX_BUF_SIZE - (uart_tx.head - uart_tx.tail);
+		uint32_t n = len - written;
+		if (n > room) {
+			n = room;
+		}
+
+		uint32_t offset = uart_tx.head & (UART_TX_BUF_SIZE - 1);
+		uint32_t first = UART_TX_BUF_SIZE - offset;
+		if (first > n) {
+			first = n;
+		}
+		memcpy(&uart_tx.buf[offset], buf + written, first);
+		memcpy(uart_tx.buf, buf + written + first, n - first);
+		uart_tx.head += n;
+
+		if (!uart_tx.dma_len) {
+			uart_tx_start();
+		}
+
+		portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+		written += n;
+		if (written < len) {
+			if (uart_tx_can_wait()) {
+				vTaskDelay(1);
+				continue;
+			}
+			uart_tx.dropped += len - written;
+			break;
+		}
+	}
+	return written;
+}
+
+/**
+ * @brief 	waits until every queued byte left the UART.
+ * @param 	timeout	: maximum ticks to wait
+ * @returns	false if the timeout expired first
+ */
+bool uart_tx_flush(TickType_t timeout)
+{
+	TickType_t start = xTaskGetTickCount();
+
+	while ((uart_tx.head != uart_tx.tail)
+			|| !(Chip_UART_ReadLineStatus(DEBUG_UART) & UART_LSR_TEMT)) {
+		if ((xTaskGetTickCount() - start) >= timeout) {
+			return false;
+		}
+		if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+			vTaskDelay(1);
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief 	returns the number of bytes dropped because the ring was full.
+ */
+uint32_t uart_tx_dropped(void)
+{
+	return uart_tx.dropped;
+}
+
+#if defined(__NEWLIB__)
+/**
+ * @brief 	newlib write hook, routes stdout and stderr through the DMA ring.
+ * @note	providing _write_r keeps newlib from pulling its own, so the
+ * 			_write retarget of the board library is no longer used.
+ */
+_ssize_t _write_r(struct _reent *r, int fd, const void *buf, size_t len)
+{
+	if ((fd != 1) && (fd != 2)) {
+		r->_errno = EBADF;
+		return -1;
+	}
+
+	uart_tx_write(buf, len);
+	return len;
+}
+#endif
@@ -14,8 +14,10 @@
 #include "debug.h"
 #include "tmr.h"
 #include "gpio.h"
+#include "mem_sections.h"
+#include "isr_stats.h"
 
-struct mot_pap x_axis;
+struct mot_pap BSS_RAMLOC32 x_axis;
 
 /**
  * @brief 	creates the queues, semaphores and endless tasks to handle X axis movements.
@@ -48,9 +50,11 @@ void x_axis_init()
  * @brief	handle interrupt from 32-bit timer to generate pulses for the stepper motor drivers
  * @returns	nothing
  */
-void TIMER1_IRQHandler(void)
+void RAMFUNC TIMER1_IRQHandler(void)
 {
+	ISR_STATS_ENTER();
 	if (tmr_match_pending(&(x_axis.tmr))) {
 		mot_pap_isr(&x_axis);
 	}
+	ISR_STATS_EXIT(ISR_STATS_TIMER1);
 }
@@ -14,8 +14,10 @@
 #include "debug.h"
 #include "tmr.h"
 #include "gpio.h"
+#include "mem_sections.h"
+#include "isr_stats.h"
 
-struct mot_pap y_axis;
+struct mot_pap BSS_RAMLOC32 y_axis;
 
 /**
  * @brief 	creates the queues, semaphores and endless tasks to handle Y axis movements.
@@ -49,9 +51,11 @@ void y_axis_init()
  * @returns	nothing
  * @note 	calls the supervisor task every x number of generated steps
  */
-void TIMER2_IRQHandler(void)
+void RAMFUNC TIMER2_IRQHandler(void)
 {
+	ISR_STATS_ENTER();
 	if (tmr_match_pending(&(y_axis.tmr))) {
 		mot_pap_isr(&y_axis);
 	}
+	ISR_STATS_EXIT(ISR_STATS_TIMER2);
 }
@@ -14,8 +14,10 @@
 #include "debug.h"
 #include "tmr.h"
 #include "gpio.h"
+#include "mem_sections.h"
+#include "isr_stats.h"
 
-struct mot_pap z_axis;
+struct mot_pap BSS_RAMLOC32 z_axis;
 
 /**
  * @brief 	creates the queues, semaphores and endless tasks to handle X axis movements.
@@ -52,9 +54,11 @@ void z_axis_init()
 =======
 >>>>>>> deferred_isr
  */
-void TIMER3_IRQHandler(void)
+void RAMFUNC TIMER3_IRQHandler(void)
 {
+	ISR_STATS_ENTER();
 	if (tmr_match_pending(&(z_axis.tmr))) {
 		mot_pap_isr(&z_axis);
 	}
+	ISR_STATS_EXIT(ISR_STATS_TIMER3);
 }
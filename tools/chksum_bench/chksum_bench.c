@@ -0,0 +1,152 @@
+/*
+ * @brief Correctness and throughput bench for lpc_chksum()
+ *
+ * @note
+ * Compares lpc_chksum() with the lwIP reference routine that cc.h selects
+ * when LPC_CHKSUM is 0, over every start offset modulo 8 and the lengths
+ * around the block and word boundaries, then times both.
+ *
+ * Not part of the firmware build. On the host it checks the portable path:
+ *
+ *   gcc -O2 -I tools/chksum_bench -I lwip/inc -I lwip/inc/ipv4 \
+ *       tools/chksum_bench/chksum_bench.c -o chksum_bench && ./chksum_bench
+ *
+ * The ADCS path is only built for the Cortex-M4. Build the same file with
+ * arm-none-eabi-gcc -mcpu=cortex-m4 -mthumb and semihosting (--specs=rdimon.specs)
+ * and run it on the board before setting LPC_CHKSUM in lwipopts.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* lwip/opt.h includes the firmware lwipopts.h by path, this one takes its
+   include guard first */
+#include "lwipopts.h"
+
+/* Both routines in one translation unit, the reference one is static */
+#include "../../lwip/src/core/def.c"
+#include "../../lwip/src/core/ipv4/inet_chksum.c"
+#include "../../lwip/src/arch/lpc_chksum.c"
+
+#define BENCH_MAX_LEN		65535
+#define BENCH_MAX_OFFSET	8
+#define BENCH_RANDOM_RUNS	20000
+#define BENCH_TIME_BYTES	(64UL * 1024 * 1024)	/* Summed per timed case */
+
+static u8_t buffer[BENCH_MAX_LEN + BENCH_MAX_OFFSET] ALIGNED(8);
+
+static u32_t bench_seed = 0x12345678;
+
+/* xorshift32, repeatable between the host and the board */
+static u32_t bench_rand(void)
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+	return bench_seed;
+}
+
+static void bench_fill(u8_t value, int random)
+{
+	for (size_t i = 0; i < sizeof(buffer); i++) {
+		buffer[i] = random ? (u8_t) bench_rand() : value;
+	}
+}
+
+/**
+ * @brief 	compares both routines on one buffer.
+ * @returns	1 if they differ
+ */
+static int bench_check(int offset, int len)
+{
+	u16_t ref = LWIP_CHKSUM(buffer + offset, len);
+	u16_t lpc = lpc_chksum(buffer + offset, len);
+
+	if (ref != lpc) {
+		printf("MISMATCH offset %d len %d: reference 0x%04x lpc 0x%04x\n",
+				offset, len, ref, lpc);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief 	checks every offset with the lengths up to 130, the lengths
+ * 			around the frame sizes and the maximum one.
+ * @returns	the number of mismatches
+ */
+static int bench_check_lengths(void)
+{
+	static const int lens[] = { 1459, 1460, 1461, 1499, 1500, 1513, 1514,
+			BENCH_MAX_LEN - 1, BENCH_MAX_LEN };
+	int errors = 0;
+
+	for (int offset = 0; offset < BENCH_MAX_OFFSET; offset++) {
+		for (int len = 0; len <= 130; len++) {
+			errors += bench_check(offset, len);
+		}
+		for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+			errors += bench_check(offset, lens[i]);
+		}
+	}
+	return errors;
+}
+
+static double bench_time(u16_t (*chksum)(const void*, int), int offset,
+		int len)
+{
+	volatile u16_t sink = 0;
+	unsigned long runs = BENCH_TIME_BYTES / len;
+
+	clock_t start = clock();
+	for (unsigned long i = 0; i < runs; i++) {
+		sink += chksum(buffer + offset, len);
+	}
+	clock_t end = clock();
+	(void) sink;
+
+	return (double) (end - start) / CLOCKS_PER_SEC * 1e9 / runs;
+}
+
+/* Same signature as lpc_chksum(), the reference routine takes a void * */
+static u16_t bench_reference(const void *dataptr, int len)
+{
+	return LWIP_CHKSUM((void*) dataptr, len);
+}
+
+int main(void)
+{
+	static const int lens[] = { 20, 64, 576, 1460 };
+	static const int offsets[] = { 0, 1, 2 };
+	int errors = 0;
+
+	bench_fill(0, 1);
+	errors += bench_check_lengths();
+	bench_fill(0xff, 0);
+	errors += bench_check_lengths();
+	bench_fill(0, 0);
+	errors += bench_check_lengths();
+
+	bench_fill(0, 1);
+	for (int i = 0; i < BENCH_RANDOM_RUNS; i++) {
+		errors += bench_check(bench_rand() % BENCH_MAX_OFFSET,
+				bench_rand() % (BENCH_MAX_LEN + 1));
+	}
+
+	printf("%s: %d mismatches\n", errors ? "FAIL" : "PASS", errors);
+
+	printf("%6s %6s %14s %14s %8s\n", "len", "offset", "reference ns",
+			"lpc_chksum ns", "speedup");
+	for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+		for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+			double ref = bench_time(bench_reference, offsets[o], lens[l]);
+			double lpc = bench_time(lpc_chksum, offsets[o], lens[l]);
+			printf("%6d %6d %14.1f %14.1f %7.2fx\n", lens[l], offsets[o], ref,
+					lpc, ref / lpc);
+		}
+	}
+
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
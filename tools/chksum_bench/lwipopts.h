@@ -0,0 +1,21 @@
+/*
+ * @brief lwIP options for the checksum bench, not for the firmware
+ *
+ * @note
+ * Just enough for lwip/src/core/ipv4/inet_chksum.c to build on its own.
+ * Included by chksum_bench.c before any lwIP header, so the firmware
+ * lwipopts.h, which needs FreeRTOS, is skipped by its include guard.
+ * LPC_CHKSUM stays 0 so the reference routine selected by cc.h is built
+ * next to lpc_chksum().
+ */
+
+#ifndef __LWIPOPTS_H_
+#define __LWIPOPTS_H_
+
+#define NO_SYS                          1
+#define LWIP_NETCONN                    0
+#define LWIP_SOCKET                     0
+#define LPC_CHKSUM                      0
+#define LWIP_NOASSERT
+
+#endif /* __LWIPOPTS_H_ */